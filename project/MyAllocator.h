@@ -4,9 +4,13 @@
 #include <memory>
 #include <iostream>
 #include <limits>
-#include <dlfcn.h>
-#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
 
+#include "arena.h"
+
+// allocates from the arena of my_omp.so, never through the (interposed) malloc
 template<typename T>
 class MyAllocator {
 public:
@@ -32,11 +36,15 @@ public:
             throw std::bad_alloc();
         }
 
-        return static_cast<pointer>(((void *(*)(size_t)) dlsym(RTLD_NEXT, "malloc"))(n * sizeof(T)));
+        auto p = static_cast<pointer>(arena::allocate(n * sizeof(T)));
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
     }
 
     void deallocate(pointer p, size_type n) noexcept {
-       ((void (*)(void *)) dlsym(RTLD_NEXT, "free"))(p);
+        arena::deallocate(p, n * sizeof(T));
     }
 
     template<typename U, typename... Args>
@@ -61,4 +69,29 @@ bool operator!=(const MyAllocator<T>&, const MyAllocator<U>&) noexcept {
     return false;
 }
 
+// objects of my_omp.so that are created with new live in the arena as well
+struct InternalObject {
+    static void *operator new(std::size_t size) {
+        void *block = arena::allocate(size);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        return block;
+    }
+
+    static void operator delete(void *block, std::size_t size) noexcept {
+        arena::deallocate(block, size);
+    }
+};
+
+// ordered map of my_omp.so whose nodes live in the arena
+template<typename K, typename V, typename Compare = std::less<K>>
+using InternalMap = std::map<K, V, Compare, MyAllocator<std::pair<const K, V>>>;
+
+// strings and vectors of my_omp.so whose memory lives in the arena
+using InternalString = std::basic_string<char, std::char_traits<char>, MyAllocator<char>>;
+
+template<typename T>
+using InternalVector = std::vector<T, MyAllocator<T>>;
+
 #endif //__MY_ALLOCATOR_H
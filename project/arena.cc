@@ -0,0 +1,145 @@
+#include "arena.h"
+
+#include <atomic>
+#include <mutex>
+#include <sys/mman.h>
+
+#define ARENA_MIN_SHIFT 4           // smallest class, 16 bytes
+#define ARENA_MAX_SHIFT 14          // largest class, 16 KiB, larger blocks are mapped one by one
+#define ARENA_CHUNK (256 * 1024)    // mapped at once to refill a class
+#define ARENA_PAGE 4096
+
+namespace arena {
+
+    const size_t CLASSES = ARENA_MAX_SHIFT - ARENA_MIN_SHIFT + 1;
+
+    struct Block {      // a free block, the list is kept in the blocks themselves
+        Block *next;
+    };
+
+    struct alignas(64) Class {
+        std::mutex lock;
+        Block *free = nullptr;
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+        uint64_t in_use = 0;
+        uint64_t peak = 0;
+        uint64_t mapped = 0;
+    };
+
+    static Class classes[CLASSES + 1];     // constant initialized, usable before any constructor ran; the last one is for large blocks
+
+    static std::atomic<uint64_t> forwarded_allocations{0};
+    static std::atomic<uint64_t> forwarded_bytes{0};
+
+    /* initial-exec, the lazy allocation of dynamic TLS could call malloc from within the malloc hook */
+    static thread_local bool own __attribute__ ((tls_model("initial-exec"))) = false;
+
+    static size_t class_of(size_t bytes) {
+        size_t shift = ARENA_MIN_SHIFT;
+        while (shift <= ARENA_MAX_SHIFT && ((size_t) 1 << shift) < bytes) shift++;
+        return shift - ARENA_MIN_SHIFT;     // CLASSES for large blocks
+    }
+
+    static size_t class_size(size_t index) {
+        return (size_t) 1 << (index + ARENA_MIN_SHIFT);
+    }
+
+    static size_t pages(size_t bytes) {
+        return (bytes + ARENA_PAGE - 1) / ARENA_PAGE * ARENA_PAGE;
+    }
+
+    static void *map(size_t bytes) {
+        void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return memory == MAP_FAILED ? nullptr : memory;
+    }
+
+    static void count(Class &c, size_t requested, size_t block) {     // c.lock has to be held
+        c.allocations++;
+        c.bytes += requested;
+        c.in_use += block;
+        if (c.in_use > c.peak) c.peak = c.in_use;
+    }
+
+    void *allocate(size_t bytes) {
+        if (bytes == 0) bytes = 1;
+        size_t index = class_of(bytes);
+        Class &c = classes[index];
+
+        if (index == CLASSES) {
+            void *block = map(pages(bytes));
+            if (!block) return nullptr;
+            std::lock_guard<std::mutex> guard(c.lock);
+            count(c, bytes, pages(bytes));
+            c.mapped += pages(bytes);
+            return block;
+        }
+
+        size_t size = class_size(index);
+        std::lock_guard<std::mutex> guard(c.lock);
+        if (!c.free) {      // carve a new chunk into blocks of the class
+            auto *chunk = (char *) map(ARENA_CHUNK);
+            if (!chunk) return nullptr;
+            c.mapped += ARENA_CHUNK;
+            for (size_t offset = ARENA_CHUNK; offset >= size; offset -= size) {
+                auto *block = (Block *) (chunk + offset - size);
+                block->next = c.free;
+                c.free = block;
+            }
+        }
+        Block *block = c.free;
+        c.free = block->next;
+        count(c, bytes, size);
+        return block;
+    }
+
+    void deallocate(void *block, size_t bytes) {
+        if (!block) return;
+        if (bytes == 0) bytes = 1;
+        size_t index = class_of(bytes);
+        Class &c = classes[index];
+
+        if (index == CLASSES) {
+            munmap(block, pages(bytes));
+            std::lock_guard<std::mutex> guard(c.lock);
+            c.in_use -= pages(bytes);
+            c.mapped -= pages(bytes);
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(c.lock);     // chunks are kept, their blocks are reused by the class
+        auto *free_block = (Block *) block;
+        free_block->next = c.free;
+        c.free = free_block;
+        c.in_use -= class_size(index);
+    }
+
+    void forwarded(size_t bytes) {
+        forwarded_allocations.fetch_add(1, std::memory_order_relaxed);
+        forwarded_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    bool internal() {
+        return own;
+    }
+
+    Scope::Scope(bool internal) : _outer(own) {
+        own = internal;
+    }
+
+    Scope::~Scope() {
+        own = _outer;
+    }
+
+    Usage usage(size_t index) {
+        Class &c = classes[index];
+        std::lock_guard<std::mutex> guard(c.lock);
+        return {index < CLASSES ? class_size(index) : 0, c.allocations, c.bytes, c.in_use, c.peak, c.mapped};
+    }
+
+    Usage forwarded_usage() {
+        return {0, forwarded_allocations.load(std::memory_order_relaxed), forwarded_bytes.load(std::memory_order_relaxed),
+                0, 0, 0};
+    }
+
+} /* namespace arena */
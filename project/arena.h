@@ -0,0 +1,65 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* \brief Memory of my_omp.so's own containers
+ *
+ * Blocks come from size classes of powers of two, each with a free list of
+ * its own that is refilled from chunks mapped with mmap; larger blocks are
+ * mapped one by one. Nothing goes through malloc, so the containers can be
+ * used from the malloc hook and do not show up in the malloc map. Blocks are
+ * returned with the size they were allocated with, as std allocators do.
+ *
+ * Allocations of my_omp.so that cannot come from here (the buffers of
+ * ofstreams, llsp and the other C code, python) are made within a Scope: the malloc hook
+ * passes them to the real malloc without recording them and only counts them. */
+namespace arena {
+
+    void *allocate(size_t bytes);
+
+    void deallocate(void *block, size_t bytes);
+
+    /* Counts an allocation the malloc hook passed on because it was made within a Scope. */
+    void forwarded(size_t bytes);
+
+    /* Whether the allocations of the calling thread are my_omp.so's own. */
+    bool internal();
+
+/* \brief Marks the allocations of the calling thread as my_omp.so's own, or as the program's, until it goes out of scope */
+    class Scope {
+        bool _outer;
+
+    public:
+        explicit Scope(bool internal = true);
+
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    struct Usage {
+        size_t size;            // of the blocks of the class, 0 for the blocks mapped one by one
+        uint64_t allocations;   // over the whole run
+        uint64_t bytes;         // requested over the whole run
+        uint64_t in_use;        // bytes of the blocks handed out now
+        uint64_t peak;          // highest in_use
+        uint64_t mapped;        // bytes mapped for the class
+    };
+
+    extern const size_t CLASSES;    // size classes, the blocks mapped one by one are one more
+
+    /* Usage of size class index, or of the blocks mapped one by one for index CLASSES. */
+    Usage usage(size_t index);
+
+    /* Usage of the allocations the malloc hook passed on, their frees are not seen. */
+    Usage forwarded_usage();
+
+} /* namespace arena */
+
+#endif /* __ARENA_H__ */
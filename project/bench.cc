@@ -0,0 +1,263 @@
+/* Microbenchmarks of the hot paths of my_omp.so, run with `make bench`.
+ *
+ * The binary links my_omp.so like a program that preloads it, so its
+ * constructor runs first and malloc is the interposed one. Benchmarks that
+ * need hardware the machine does not have (PMU, RAPL, the python predictors)
+ * are reported as skipped instead of failing the run. */
+
+#include <benchmark/benchmark.h>
+
+#include <alloca.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "perf.h"
+#include "energy.h"
+#include "predictor_py.h"
+#include "MyAllocator.h"
+#include "arena.h"
+#include "feature_map.h"
+
+extern "C" {    // llsp.h uses restrict, which is not C++
+typedef struct llsp_s llsp_t;
+llsp_t *llsp_new(size_t count);
+void llsp_add(llsp_t *llsp, const double *metrics, double target);
+const double *llsp_solve(llsp_t *llsp);
+double llsp_predict(llsp_t *llsp, const double *metrics);
+void llsp_dispose(llsp_t *llsp);
+}
+
+#define BENCH_SAMPLES 64    // rows fed to a model before it is solved or asked
+#define BENCH_EVENTS 6
+
+static const int max_threads = (int) std::max(1u, std::thread::hardware_concurrency());
+
+static std::vector<double> random_rows(size_t rows, size_t metrics) {
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> value(1.0, 1000.0);
+    std::vector<double> data(rows * metrics);
+    for (auto &v: data) v = value(random);
+    return data;
+}
+
+static llsp_t *trained_llsp(size_t metrics, const std::vector<double> &rows) {
+    llsp_t *llsp = llsp_new(metrics);
+    for (size_t r = 0; r < BENCH_SAMPLES; r++) llsp_add(llsp, &rows[r * metrics], rows[r * metrics] * 3.0);
+    llsp_solve(llsp);
+    return llsp;
+}
+
+static void BM_llsp_add(benchmark::State &state) {
+    const size_t metrics = state.range(0);
+    auto rows = random_rows(BENCH_SAMPLES, metrics);
+    llsp_t *llsp = llsp_new(metrics);
+    size_t r = 0;
+    for (auto _: state) {
+        llsp_add(llsp, &rows[r * metrics], 1.0);
+        r = (r + 1) % BENCH_SAMPLES;
+    }
+    llsp_dispose(llsp);
+}
+BENCHMARK(BM_llsp_add)->RangeMultiplier(2)->Range(2, 64);
+
+static void BM_llsp_solve(benchmark::State &state) {
+    const size_t metrics = state.range(0);
+    auto rows = random_rows(BENCH_SAMPLES, metrics);
+    llsp_t *llsp = trained_llsp(metrics, rows);
+    for (auto _: state) benchmark::DoNotOptimize(llsp_solve(llsp));
+    llsp_dispose(llsp);
+}
+BENCHMARK(BM_llsp_solve)->RangeMultiplier(2)->Range(2, 64);
+
+static void BM_llsp_predict(benchmark::State &state) {
+    const size_t metrics = state.range(0);
+    auto rows = random_rows(BENCH_SAMPLES, metrics);
+    llsp_t *llsp = trained_llsp(metrics, rows);
+    size_t r = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(llsp_predict(llsp, &rows[r * metrics]));
+        r = (r + 1) % BENCH_SAMPLES;
+    }
+    llsp_dispose(llsp);
+}
+BENCHMARK(BM_llsp_predict)->RangeMultiplier(2)->Range(2, 64);
+
+/* The search of a data block for the arrays malloc has seen, it walks from the block to the end of the stack,
+ * so range(0) is the depth of the block in bytes. The malloc map only grows, so its size range(1) is the
+ * argument that changes last. */
+static void BM_discover_features(benchmark::State &state) {
+    static std::vector<void *> blocks;
+    while (malloc_map.size() < (size_t) state.range(1)) blocks.push_back(malloc(16));
+
+    const size_t depth = state.range(0);
+    void *data = alloca(depth);
+    memset(data, 0, depth);     // no pointers malloc knows, the whole stack is searched
+    for (auto _: state) {
+        FeatureMap features;
+        discover_features(features, data);
+        benchmark::DoNotOptimize(features.scans);
+    }
+    state.counters["map_size"] = (double) malloc_map.size();
+}
+BENCHMARK(BM_discover_features)->ArgsProduct({{1 << 10, 1 << 14, 1 << 18}, {1 << 10, 1 << 14, 1 << 18}});
+
+static void BM_perf_read(benchmark::State &state) {
+    auto topology = state.range(0) ? perf::Topology::MULTI : perf::Topology::SINGLE;
+    state.SetLabel(state.range(0) ? "multi_pmu" : "single_pmu");
+    auto handle = perf::PerfManager(topology).open(getpid());
+    if (!handle || !handle.value()) {    // open() returns an empty handle if no event could be opened
+        state.SkipWithError("perf events are not available");
+        return;
+    }
+    for (auto _: state) benchmark::DoNotOptimize(handle.value()->read());
+}
+BENCHMARK(BM_perf_read)->Arg(0)->Arg(1);
+
+static void BM_energy_read(benchmark::State &state) {
+    energy::PerfMeasure measure;
+    if (measure.read() == 0) {
+        state.SkipWithError("RAPL is not available");
+        return;
+    }
+    for (auto _: state) benchmark::DoNotOptimize(measure.read());
+}
+BENCHMARK(BM_energy_read);
+
+/* The counter reads of a region entry with a monitoring thread alongside: range(0) 0 runs none, 1 one that
+ * reads fds of its own as my_omp's does, 2 one that reads the same fds as the entries, as it used to.
+ * max_ns is the slowest entry, it should not depend on the monitoring thread as long as it has its own fds. */
+static void BM_region_entry(benchmark::State &state) {
+    auto handle = perf::PerfManager().open(getpid());
+    auto monitor_handle = perf::PerfManager().open(getpid());
+    if (!handle || !handle.value() || !monitor_handle || !monitor_handle.value()) {
+        state.SkipWithError("perf events are not available");
+        return;
+    }
+    perf::Handle &counters = *handle.value();
+    energy::PerfMeasure energy;
+    energy::PerfMeasure monitor_energy;
+
+    const long mode = state.range(0);
+    state.SetLabel(mode == 0 ? "no_monitor" : mode == 1 ? "own_fds" : "shared_fds");
+    perf::Handle &monitor_counters = mode == 1 ? *monitor_handle.value() : counters;
+    energy::PerfMeasure &monitor_joules = mode == 1 ? monitor_energy : energy;
+    std::atomic<bool> running{true};
+    std::thread monitoring([&]() {
+        while (mode != 0 && running.load(std::memory_order_relaxed)) {
+            benchmark::DoNotOptimize(monitor_counters.read());
+            benchmark::DoNotOptimize(monitor_joules.read());
+        }
+    });
+
+    std::chrono::steady_clock::duration slowest{0};
+    for (auto _: state) {
+        auto begin = std::chrono::steady_clock::now();
+        benchmark::DoNotOptimize(counters.read());
+        benchmark::DoNotOptimize(energy.read());
+        slowest = std::max(slowest, std::chrono::steady_clock::now() - begin);
+    }
+    running.store(false, std::memory_order_relaxed);
+    monitoring.join();
+    state.counters["max_ns"] = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(slowest).count();
+}
+BENCHMARK(BM_region_entry)->DenseRange(0, 2)->UseRealTime();
+
+/* The interposed malloc, every call takes the locks of the malloc map. free is not hooked, so the entries
+ * of a run are taken out again afterwards and each run starts with the same map. */
+static InternalMap<long long, size_t> saved_malloc_map;
+
+static void save_malloc_map(const benchmark::State &) {
+    std::lock_guard<std::mutex> guard(map_lock);
+    saved_malloc_map = malloc_map;
+}
+
+static void restore_malloc_map(const benchmark::State &) {
+    std::lock_guard<std::mutex> guard(map_lock);
+    malloc_map = saved_malloc_map;
+    saved_malloc_map.clear();
+}
+
+static void BM_malloc(benchmark::State &state) {
+    for (auto _: state) {
+        void *block = malloc(64);
+        benchmark::DoNotOptimize(block);
+        free(block);
+    }
+}
+BENCHMARK(BM_malloc)->ThreadRange(1, max_threads)->UseRealTime()->Setup(save_malloc_map)->Teardown(restore_malloc_map);
+
+/* The allocator of the containers of my_omp.so, range(0) is the block size, the largest is mapped on its own. */
+static void BM_arena(benchmark::State &state) {
+    const size_t bytes = state.range(0);
+    for (auto _: state) {
+        void *block = arena::allocate(bytes);
+        benchmark::DoNotOptimize(block);
+        arena::deallocate(block, bytes);
+    }
+}
+BENCHMARK(BM_arena)->RangeMultiplier(16)->Range(16, 1 << 16)->ThreadRange(1, max_threads)->UseRealTime();
+
+static bool python_available() {
+    static bool available = [] {
+        if (!Py_IsInitialized()) python::init();    // my_omp.so did it already if PREDICTOR is a python one
+        python::GIL gil;
+        PyObject *module = PyImport_ImportModule("predictor");
+        if (!module) PyErr_Clear();
+        Py_XDECREF(module);
+        return module != nullptr;
+    }();
+    return available;
+}
+
+/* range(0) selects the predictor, see predictor.py */
+static const char *const python_predictors[] = {"poly", "gpr", "nn", "svm"};
+
+static void BM_python_fit(benchmark::State &state) {
+    const char *name = python_predictors[state.range(0)];
+    state.SetLabel(name);
+    if (!python_available()) {
+        state.SkipWithError("predictor.py cannot be imported");
+        return;
+    }
+    const unsigned int metrics = 8;
+    auto rows = random_rows(BENCH_SAMPLES, metrics + BENCH_EVENTS);
+    python::Predictor predictor(name, metrics, BENCH_EVENTS);
+    size_t r = 0;
+    for (auto _: state) {
+        const double *row = &rows[r * (metrics + BENCH_EVENTS)];
+        predictor.fit(row, row + metrics);
+        r = (r + 1) % BENCH_SAMPLES;
+    }
+}
+BENCHMARK(BM_python_fit)->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+
+static void BM_python_predict(benchmark::State &state) {
+    const char *name = python_predictors[state.range(0)];
+    state.SetLabel(name);
+    if (!python_available()) {
+        state.SkipWithError("predictor.py cannot be imported");
+        return;
+    }
+    const unsigned int metrics = 8;
+    auto rows = random_rows(BENCH_SAMPLES, metrics + BENCH_EVENTS);
+    python::Predictor predictor(name, metrics, BENCH_EVENTS);
+    for (size_t r = 0; r < BENCH_SAMPLES; r++) {
+        const double *row = &rows[r * (metrics + BENCH_EVENTS)];
+        predictor.fit(row, row + metrics);
+    }
+    double predicted[BENCH_EVENTS];
+    size_t r = 0;
+    for (auto _: state) {
+        predictor.predict(&rows[r * (metrics + BENCH_EVENTS)], predicted);
+        r = (r + 1) % BENCH_SAMPLES;
+    }
+}
+BENCHMARK(BM_python_predict)->DenseRange(0, 3)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "daemon_protocol.h"
+#include "debug_util.h"
+#include "model_store.h"
+
+/* graybox-daemon: serves predictions to all processes that run my_omp.so with
+ * PREDICTOR=daemon. Regions are identified by their stable key, so every run of
+ * the same binary trains and uses the same models. With MODEL_STORE set, the
+ * models are loaded from and written back to the same store my_omp.so uses. */
+
+extern "C" {
+
+typedef struct llsp_s llsp_t;
+
+llsp_t *llsp_new(size_t count);
+
+void llsp_add(llsp_t *llsp, const double *metrics, double target);
+
+const double *llsp_solve(llsp_t *llsp);
+
+double llsp_predict(llsp_t *llsp, const double *metrics);
+
+void llsp_dispose(llsp_t *llsp);
+
+size_t llsp_state_size(const llsp_t *llsp);
+
+void llsp_save(const llsp_t *llsp, void *buffer);
+
+bool llsp_load(llsp_t *llsp, const void *buffer, size_t size);
+
+void llsp_merge(llsp_t *llsp, const llsp_t *other);
+
+}
+
+using namespace daemon_protocol;
+
+#define MAX_METRICS 64
+#define MAX_EVENTS 16
+#define IDLE_TIMEOUT 10     // ms without requests after which pending solves are done
+
+struct Region {
+    std::string key;
+    uint32_t metrics;
+    std::vector<llsp_t *> solvers;     // one per event
+    std::vector<llsp_t *> changes;     // only the samples since the last write of the store, with a store
+    bool dirty = false;                 // fed since the last solve
+};
+
+struct Connection {
+    int fd;
+    uint32_t metrics = 0;
+    uint32_t events = 0;
+    std::vector<char> in;               // received bytes not yet handled
+};
+
+std::vector<Region> regions;
+std::map<std::string, uint32_t> region_ids;     // key and metrics count -> index in regions
+std::unique_ptr<model_store::Store> store;
+
+volatile sig_atomic_t running = 1;
+
+void stop(int) {
+    running = 0;
+}
+
+model_store::Entry save_llsps(const std::vector<llsp_t *> &solvers, uint32_t metrics) {  // all solvers of a region, each prefixed with its size
+    model_store::Entry entry;
+    entry.kind = model_store::LLSP;
+    entry.metrics = metrics;
+    for (auto solver: solvers) {
+        uint64_t size = llsp_state_size(solver);
+        size_t offset = entry.payload.size();
+        entry.payload.resize(offset + sizeof(size) + size);
+        memcpy(entry.payload.data() + offset, &size, sizeof(size));
+        llsp_save(solver, entry.payload.data() + offset + sizeof(size));
+    }
+    return entry;
+}
+
+bool load_llsps(std::vector<llsp_t *> &solvers, const model_store::Entry &entry) {
+    size_t offset = 0;
+    for (auto solver: solvers) {
+        uint64_t size;
+        if (offset + sizeof(size) > entry.payload.size()) return false;
+        memcpy(&size, entry.payload.data() + offset, sizeof(size));
+        offset += sizeof(size);
+        if (offset + size > entry.payload.size()) return false;
+        if (!llsp_load(solver, entry.payload.data() + offset, size)) return false;
+        offset += size;
+    }
+    return offset == entry.payload.size();     // stores written with another set of events do not fit
+}
+
+void merge_models(const std::string &key, model_store::Entry &ours, const model_store::Entry &theirs) {
+    if (ours.kind != model_store::LLSP) return;
+
+    size_t events = 0;      // the number of solvers is implicit in the payload
+    for (size_t offset = 0; offset + sizeof(uint64_t) <= ours.payload.size(); events++) {
+        uint64_t size;
+        memcpy(&size, ours.payload.data() + offset, sizeof(size));
+        offset += sizeof(size) + size;
+    }
+
+    Region mine{key, ours.metrics}, other{key, ours.metrics};
+    for (size_t i = 0; i < events; i++) {
+        mine.solvers.push_back(llsp_new(ours.metrics));
+        other.solvers.push_back(llsp_new(ours.metrics));
+    }
+    if (load_llsps(mine.solvers, ours) && load_llsps(other.solvers, theirs)) {
+        for (size_t i = 0; i < events; i++) {
+            llsp_merge(mine.solvers[i], other.solvers[i]);
+            llsp_solve(mine.solvers[i]);
+        }
+        uint64_t generation = ours.generation;
+        ours = save_llsps(mine.solvers, mine.metrics);
+        ours.generation = generation;
+    }
+    for (size_t i = 0; i < events; i++) {
+        llsp_dispose(mine.solvers[i]);
+        llsp_dispose(other.solvers[i]);
+    }
+}
+
+void save_models() {
+    if (!store) return;
+    for (auto &region: regions) {
+        model_store::Entry entry = save_llsps(region.solvers, region.metrics);
+        entry.changes = save_llsps(region.changes, region.metrics).payload;
+        store->put(region.key, std::move(entry));
+    }
+    if (!store->write(merge_models)) return;
+    for (auto &region: regions) {   // continue from what was written, it is the base the next write merges against
+        if (auto entry = store->find(region.key, model_store::LLSP, region.metrics))
+            load_llsps(region.solvers, *entry);
+        for (auto &solver: region.changes) {
+            llsp_dispose(solver);
+            solver = llsp_new(region.metrics);
+        }
+    }
+}
+
+uint32_t find_region(const std::string &key, uint32_t metrics, uint32_t events) {
+    std::string id = key + "/" + std::to_string(metrics) + "/" + std::to_string(events);
+    if (auto it = region_ids.find(id); it != region_ids.end())
+        return it->second;
+
+    Region region{key, metrics};
+    for (uint32_t i = 0; i < events; i++) {
+        region.solvers.push_back(llsp_new(metrics));
+        if (store) region.changes.push_back(llsp_new(metrics));
+    }
+
+    if (store) {
+        auto entry = store->find(key, model_store::LLSP, metrics);
+        if (entry && load_llsps(region.solvers, *entry))
+            LOGGER->info("Restored llsp models of %s\n", key.c_str());
+    }
+
+    regions.push_back(std::move(region));
+    region_ids[id] = regions.size() - 1;
+    LOGGER->info("New region %lu: %s\n", regions.size() - 1, key.c_str());
+    return regions.size() - 1;
+}
+
+void solve(Region &region) {
+    for (auto solver: region.solvers)
+        llsp_solve(solver);
+    region.dirty = false;
+}
+
+bool reply(int fd, uint32_t type, const void *payload, size_t size) {
+    header h{type, static_cast<uint32_t>(size)};
+    char buffer[sizeof(h) + size];
+    memcpy(buffer, &h, sizeof(h));
+    memcpy(buffer + sizeof(h), payload, size);
+    return send(fd, buffer, sizeof(buffer), MSG_NOSIGNAL) == (ssize_t) sizeof(buffer);
+}
+
+/* Returns the region a sample message refers to, or nullptr if the message does not fit this connection. */
+Region *sample_region(const Connection &conn, const char *payload, size_t size, size_t expected) {
+    if (size != expected) return nullptr;
+    sample_header sh;
+    memcpy(&sh, payload, sizeof(sh));
+    if (sh.region >= regions.size() || regions[sh.region].metrics != conn.metrics ||
+        regions[sh.region].solvers.size() != conn.events)
+        return nullptr;
+    return &regions[sh.region];
+}
+
+bool handle(Connection &conn, uint32_t type, const char *payload, size_t size) {
+    size_t metrics_size = conn.metrics * sizeof(double);
+
+    switch (type) {
+        case HELLO: {
+            if (size != sizeof(hello_msg)) return false;
+            hello_msg hello;
+            memcpy(&hello, payload, sizeof(hello));
+            bool ok = hello.version == VERSION && hello.metrics > 0 && hello.metrics <= MAX_METRICS &&
+                      hello.events > 0 && hello.events <= MAX_EVENTS;
+            if (ok) {
+                conn.metrics = hello.metrics;
+                conn.events = hello.events;
+            }
+            hello.version = VERSION;
+            hello.status = ok ? 0 : 1;
+            return reply(conn.fd, HELLO, &hello, sizeof(hello)) && ok;
+        }
+        case REGISTER: {
+            if (size != sizeof(register_msg) || conn.metrics == 0) return false;
+            auto reg = reinterpret_cast<const register_msg *>(payload);
+            region_msg answer{find_region(std::string(reg->key, strnlen(reg->key, KEY_SIZE)), conn.metrics, conn.events)};
+            return reply(conn.fd, REGION, &answer, sizeof(answer));
+        }
+        case FEED: {
+            Region *region = sample_region(conn, payload, size, sizeof(sample_header) + metrics_size + conn.events * sizeof(double));
+            if (!region) return false;
+            double metrics[conn.metrics], results[conn.events];
+            memcpy(metrics, payload + sizeof(sample_header), metrics_size);
+            memcpy(results, payload + sizeof(sample_header) + metrics_size, conn.events * sizeof(double));
+            for (uint32_t i = 0; i < conn.events; i++) {
+                llsp_add(region->solvers[i], metrics, results[i]);
+                if (!region->changes.empty()) llsp_add(region->changes[i], metrics, results[i]);
+            }
+            region->dirty = true;
+            return true;
+        }
+        case PREDICT: {
+            Region *region = sample_region(conn, payload, size, sizeof(sample_header) + metrics_size);
+            if (!region) return false;
+            if (region->dirty) solve(*region);     // usually already done while idle
+            double metrics[conn.metrics], predicted[conn.events];
+            memcpy(metrics, payload + sizeof(sample_header), metrics_size);
+            for (uint32_t i = 0; i < conn.events; i++)
+                predicted[i] = llsp_predict(region->solvers[i], metrics);
+            return reply(conn.fd, PREDICTION, predicted, sizeof(predicted));
+        }
+        default:
+            LOGGER->warning("Unknown message type %u\n", type);
+            return false;
+    }
+}
+
+/* Handles all complete messages received on the connection, returns false if it has to be closed. */
+bool receive(Connection &conn) {
+    char buffer[64 * 1024];
+    ssize_t n = read(conn.fd, buffer, sizeof(buffer));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return true;
+    if (n <= 0)
+        return false;
+    conn.in.insert(conn.in.end(), buffer, buffer + n);
+
+    size_t offset = 0;
+    while (conn.in.size() - offset >= sizeof(header)) {
+        header h;
+        memcpy(&h, conn.in.data() + offset, sizeof(h));
+        if (conn.in.size() - offset - sizeof(h) < h.size)
+            break;
+        if (!handle(conn, h.type, conn.in.data() + offset + sizeof(h), h.size)) {
+            LOGGER->warning("Dropping client after invalid message %u\n", h.type);
+            return false;
+        }
+        offset += sizeof(h) + h.size;
+    }
+    conn.in.erase(conn.in.begin(), conn.in.begin() + offset);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::string path = argc > 1 ? argv[1] : (getenv("DAEMON_SOCKET") ?: DEFAULT_SOCKET);
+
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        LOGGER->error("Socket path %s is too long\n", path.c_str());
+        return 1;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());   // left over from a previous daemon
+    if (listen_fd == -1 || bind(listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1 ||
+        listen(listen_fd, 64) == -1) {
+        LOGGER->error("Failed to listen on %s: %s\n", path.c_str(), strerror(errno));
+        return 1;
+    }
+
+    if (getenv("MODEL_STORE")) store = std::make_unique<model_store::Store>(getenv("MODEL_STORE"));
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    printf("graybox-daemon listening on %s\n", path.c_str());
+    fflush(stdout);
+
+    std::vector<Connection> connections;
+    while (running) {
+        std::vector<struct pollfd> fds{{listen_fd, POLLIN, 0}};
+        for (auto &conn: connections)
+            fds.push_back({conn.fd, POLLIN, 0});
+
+        bool pending = false;
+        for (auto &region: regions)
+            pending |= region.dirty;
+
+        int ready = poll(fds.data(), fds.size(), pending ? IDLE_TIMEOUT : -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            LOGGER->error("poll failed: %s\n", strerror(errno));
+            break;
+        }
+        if (ready == 0) {   // idle: solve now so that the next prediction is answered right away
+            for (auto &region: regions)
+                if (region.dirty) solve(region);
+            continue;
+        }
+
+        bool disconnected = false;
+        for (size_t i = fds.size() - 1; i > 0; i--) {
+            if (fds[i].revents == 0) continue;
+            if (!receive(connections[i - 1])) {
+                close(connections[i - 1].fd);
+                connections.erase(connections.begin() + (i - 1));
+                disconnected = true;
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd != -1) connections.push_back({fd});
+        }
+
+        if (disconnected && connections.empty()) save_models();     // all runs are done, keep the models safe
+    }
+
+    for (auto &conn: connections)
+        close(conn.fd);
+    close(listen_fd);
+    unlink(path.c_str());
+
+    save_models();
+    for (auto &region: regions)
+        for (auto solver: region.solvers)
+            llsp_dispose(solver);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include "daemon_client.h"
+#include "daemon_protocol.h"
+#include "debug_util.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace daemon_client {
+
+    using namespace daemon_protocol;
+
+    /* Feeds are sent at the latest when this many bytes are queued */
+    static const size_t BATCH_LIMIT = 64 * 1024;
+
+    static bool write_all(int fd, const char *data, size_t size) {
+        while (size > 0) {
+            ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    static bool read_all(int fd, char *data, size_t size) {
+        while (size > 0) {
+            ssize_t n = read(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    Client::Client(int fd, unsigned int metrics, unsigned int events)
+            : _fd{fd}, _metrics{metrics}, _events{events} {
+        _batch.reserve(BATCH_LIMIT);
+    }
+
+    Client::~Client() {
+        flush();
+        close(_fd);
+    }
+
+    std::unique_ptr<Client> Client::connect(const std::string &path, unsigned int metrics, unsigned int events) {
+        struct sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            LOGGER->error("Daemon socket path %s is too long\n", path.c_str());
+            return nullptr;
+        }
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            LOGGER->error("Failed to create daemon socket: %s\n", strerror(errno));
+            return nullptr;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1) {
+            LOGGER->warning("No predictor daemon at %s: %s\n", path.c_str(), strerror(errno));
+            close(fd);
+            return nullptr;
+        }
+
+        std::unique_ptr<Client> client(new Client(fd, metrics, events));
+
+        hello_msg hello{VERSION, metrics, events, 0};
+        client->append(HELLO, &hello, sizeof(hello));
+        if (!client->send_batch() || !client->receive(HELLO, &hello, sizeof(hello)) || hello.status != 0) {
+            LOGGER->error("Predictor daemon at %s refused the connection\n", path.c_str());
+            return nullptr;
+        }
+
+        LOGGER->info("Connected to predictor daemon at %s\n", path.c_str());
+        return client;
+    }
+
+    void Client::append(uint32_t type, const void *payload, size_t size) {
+        header h{type, static_cast<uint32_t>(size)};
+        auto bytes = reinterpret_cast<const char *>(&h);
+        _batch.insert(_batch.end(), bytes, bytes + sizeof(h));
+        bytes = static_cast<const char *>(payload);
+        _batch.insert(_batch.end(), bytes, bytes + size);
+    }
+
+    bool Client::send_batch() {
+        bool ok = write_all(_fd, _batch.data(), _batch.size());
+        _batch.clear();
+        return ok;
+    }
+
+    bool Client::receive(uint32_t type, void *payload, size_t size) {
+        header h;
+        if (!read_all(_fd, reinterpret_cast<char *>(&h), sizeof(h)))
+            return false;
+        if (h.type != type || h.size != size) {
+            LOGGER->error("Unexpected message %u of size %u from predictor daemon\n", h.type, h.size);
+            return false;
+        }
+        return read_all(_fd, static_cast<char *>(payload), size);
+    }
+
+    int64_t Client::region(std::string_view key) {
+        register_msg reg;
+        memset(&reg, 0, sizeof(reg));
+        if (key.size() >= KEY_SIZE) {
+            LOGGER->warning("Region key %.*s is too long for the predictor daemon\n", (int) key.size(), key.data());
+            return -1;
+        }
+        memcpy(reg.key, key.data(), key.size());     // zero terminated by the memset
+
+        region_msg answer;
+        append(REGISTER, &reg, sizeof(reg));
+        if (!send_batch() || !receive(REGION, &answer, sizeof(answer)))
+            return -1;
+        return answer.region;
+    }
+
+    bool Client::predict(uint32_t region, const double *metrics, double *predictions) {
+        char payload[sizeof(sample_header) + _metrics * sizeof(double)];
+        sample_header sh{region, 0};
+        memcpy(payload, &sh, sizeof(sh));
+        memcpy(payload + sizeof(sh), metrics, _metrics * sizeof(double));
+
+        append(PREDICT, payload, sizeof(payload));
+        return send_batch() && receive(PREDICTION, predictions, _events * sizeof(double));
+    }
+
+    void Client::feed(uint32_t region, const double *metrics, const double *results) {
+        char payload[sizeof(sample_header) + (_metrics + _events) * sizeof(double)];
+        sample_header sh{region, 0};
+        memcpy(payload, &sh, sizeof(sh));
+        memcpy(payload + sizeof(sh), metrics, _metrics * sizeof(double));
+        memcpy(payload + sizeof(sh) + _metrics * sizeof(double), results, _events * sizeof(double));
+
+        append(FEED, payload, sizeof(payload));
+        if (_batch.size() >= BATCH_LIMIT)
+            send_batch();
+    }
+
+    bool Client::flush() {
+        if (_batch.empty())
+            return true;
+        return send_batch();
+    }
+
+} /* namespace daemon_client */
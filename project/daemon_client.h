@@ -0,0 +1,59 @@
+#ifndef __DAEMON_CLIENT_H__
+#define __DAEMON_CLIENT_H__
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace daemon_client {
+
+/* \brief Connection of an instrumented process to graybox-daemon
+ *
+ * Predictions are made by the daemon from models it shares between all
+ * processes running the same binary. Measurements are only buffered here and
+ * travel with the next request. */
+    class Client {
+    private:
+        int _fd;
+        unsigned int _metrics;
+        unsigned int _events;
+        // FEED messages waiting for the next request
+        std::vector<char> _batch;
+
+        void append(uint32_t type, const void *payload, size_t size);
+
+        bool send_batch();
+
+        bool receive(uint32_t type, void *payload, size_t size);
+
+        Client(int fd, unsigned int metrics, unsigned int events);
+
+    public:
+        ~Client();
+
+        Client(const Client &) = delete;
+
+        Client &operator=(const Client &) = delete;
+
+        /* Connects to the daemon listening on the given socket, nullptr if there is none. */
+        static std::unique_ptr<Client> connect(const std::string &path, unsigned int metrics, unsigned int events);
+
+        /* Returns the daemon's id for the region with the given stable key, or -1 on failure. */
+        int64_t region(std::string_view key);
+
+        /* Fills predictions with one value per event, returns false if the daemon is gone. */
+        bool predict(uint32_t region, const double *metrics, double *predictions);
+
+        /* Queues a measurement, it is sent with the next request or by flush(). */
+        void feed(uint32_t region, const double *metrics, const double *results);
+
+        bool flush();
+    };
+
+} /* namespace daemon_client */
+
+#endif /* __DAEMON_CLIENT_H__ */
@@ -0,0 +1,65 @@
+#ifndef __DAEMON_PROTOCOL_H__
+#define __DAEMON_PROTOCOL_H__
+
+#pragma once
+
+#include <cstdint>
+
+/* Wire format between my_omp.so and graybox-daemon on a UNIX stream socket.
+ * Both ends run on the same node, so all values are in native byte order.
+ * Every message is a header followed by 'size' bytes of payload:
+ *
+ *   HELLO      client -> daemon   hello_msg                     answered by HELLO
+ *   REGISTER   client -> daemon   register_msg                  answered by REGION
+ *   FEED       client -> daemon   region id, metrics, results   not answered
+ *   PREDICT    client -> daemon   region id, metrics            answered by PREDICTION
+ *
+ * The client batches FEED messages and only sends them together with the next
+ * message that needs an answer, so a region entry costs a single round trip. */
+
+namespace daemon_protocol {
+
+    const uint32_t VERSION = 1;
+    const uint32_t KEY_SIZE = 96;
+    const char *const DEFAULT_SOCKET = "/tmp/graybox.sock";
+
+    enum Type : uint32_t {
+        HELLO      = 1,
+        REGISTER   = 2,
+        REGION     = 3,
+        FEED       = 4,
+        PREDICT    = 5,
+        PREDICTION = 6
+    };
+
+    struct header {
+        uint32_t type;
+        uint32_t size;
+    };
+
+    struct hello_msg {
+        uint32_t version;
+        uint32_t metrics;       // number of metrics per sample
+        uint32_t events;        // number of predicted values per sample
+        uint32_t status;        // set by the daemon: 0 on success
+    };
+
+    struct register_msg {
+        char key[KEY_SIZE];     // elf_util::stable_key of the region, regions with the same key share a model
+    };
+
+    struct region_msg {
+        uint32_t region;
+    };
+
+    /* FEED:       uint32_t region, padding, double metrics[metrics], double results[events]
+     * PREDICT:    uint32_t region, padding, double metrics[metrics]
+     * PREDICTION: double predictions[events] */
+    struct sample_header {
+        uint32_t region;
+        uint32_t padding;
+    };
+
+} /* namespace daemon_protocol */
+
+#endif /* __DAEMON_PROTOCOL_H__ */
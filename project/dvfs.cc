@@ -0,0 +1,145 @@
+#include "dvfs.h"
+#include "debug_util.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <sched.h>      // sched_getaffinity
+
+
+namespace dvfs {
+
+    std::string cpufreq_root() {
+        const char *root = getenv("CPUFREQ_ROOT");
+        return root ? root : "/sys/devices/system/cpu";
+    }
+
+    static std::string read_file(const std::string &path) {
+        std::ifstream file(path);
+        std::string content;
+        std::getline(file, content);
+        return content;
+    }
+
+    FrequencyGovernor::FrequencyGovernor(std::string root, std::vector<int> cpus, double threshold, unsigned int hold)
+            : _root{std::move(root)}, _threshold{threshold}, _hold{std::max(hold, 1u)}, _current{0}, _nominal{0}, _changed{false} {
+        for (int id: cpus) {
+            std::string dir = _root + "/cpu" + std::to_string(id) + "/cpufreq/";
+            std::string governor = read_file(dir + "scaling_governor");
+            if (governor.empty())
+                continue;   // no cpufreq for this cpu
+
+            std::string file = dir + (governor == "userspace" ? "scaling_setspeed" : "scaling_max_freq");
+            _cpus.push_back({id, file, read_file(file)});
+            if (_current == 0)
+                _current = strtoul(_cpus.back().original.c_str(), nullptr, 10);
+
+            if (!_frequencies.empty())
+                continue;   // all cpus of a node are assumed to offer the same frequencies
+            std::istringstream available(read_file(dir + "scaling_available_frequencies"));
+            unsigned long khz;
+            while (available >> khz)
+                _frequencies.push_back(khz);
+            if (_frequencies.empty()) {     // e.g. intel_pstate, only the bounds are known
+                for (auto name: {"cpuinfo_min_freq", "cpuinfo_max_freq"}) {
+                    std::string bound = read_file(dir + name);
+                    if (!bound.empty()) _frequencies.push_back(strtoul(bound.c_str(), nullptr, 10));
+                }
+            }
+            std::sort(_frequencies.begin(), _frequencies.end());
+            _frequencies.erase(std::unique(_frequencies.begin(), _frequencies.end()), _frequencies.end());
+        }
+        _nominal = _current;
+        if (_nominal == 0 && !_frequencies.empty())
+            _nominal = _frequencies.back();     // unreadable setting, the maximum is what the governor restores to anyway
+    }
+
+    FrequencyGovernor::~FrequencyGovernor() {
+        restore();
+    }
+
+    std::unique_ptr<FrequencyGovernor> FrequencyGovernor::from_env() {
+        if (!getenv("DVFS"))
+            return nullptr;
+
+        std::vector<int> cpus;
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+
+        double threshold = getenv("DVFS_MISS_RATIO") ? atof(getenv("DVFS_MISS_RATIO")) : 0.01;
+        unsigned int hold = getenv("DVFS_HOLD") ? atoi(getenv("DVFS_HOLD")) : 2;
+
+        auto governor = std::make_unique<FrequencyGovernor>(cpufreq_root(), cpus, threshold, hold);
+        if (!governor->usable()) {
+            LOGGER->warning("No cpufreq under %s, frequency governor disabled\n", cpufreq_root().c_str());
+            return nullptr;
+        }
+        LOGGER->info("Frequency governor for %lu cpus with %lu frequencies\n", governor->_cpus.size(),
+                     governor->_frequencies.size());
+        return governor;
+    }
+
+    unsigned long FrequencyGovernor::choose(double miss_ratio, const Energy &energy) const {
+        unsigned long max = _frequencies.back();
+        if (miss_ratio < _threshold)
+            return max;     // compute-bound
+
+        /* Scale down with the miss ratio, reaching the minimum at twice the threshold */
+        double boundness = std::min((miss_ratio - _threshold) / _threshold, 1.0);
+        double target = max - boundness * (max - _frequencies.front());
+        auto khz = *std::lower_bound(_frequencies.begin(), _frequencies.end(), (unsigned long) target);
+
+        /* Only go down if the model does not expect to lose energy with it */
+        double at_max, at_khz;
+        if (khz != max && energy(max, at_max) && energy(khz, at_khz) && at_khz > at_max)
+            return max;
+        return khz;
+    }
+
+    bool FrequencyGovernor::write(const std::string &file, const std::string &value) {
+        std::ofstream out(file);
+        out << value << std::endl;
+        if (!out.good()) {
+            LOGGER->warning("Failed to write %s\n", file.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool FrequencyGovernor::apply(const void *region, unsigned long khz) {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        /* hysteresis: the region has to ask for the same frequency on several of its entries in a row */
+        Streak &streak = _streaks[region];
+        if (khz != streak.khz) {
+            streak.khz = khz;
+            streak.count = 0;
+        }
+        if (streak.count < _hold)
+            streak.count++;
+        if (khz == _current || streak.count < _hold)
+            return false;
+
+        std::string value = std::to_string(khz);
+        for (auto &cpu: _cpus)
+            write(cpu.file, value);
+        _current = khz;
+        _changed = true;
+        return true;
+    }
+
+    void FrequencyGovernor::restore() {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (!_changed)
+            return;
+        for (auto &cpu: _cpus)
+            if (!cpu.original.empty()) write(cpu.file, cpu.original);
+        _current = strtoul(_cpus.front().original.c_str(), nullptr, 10);
+        _changed = false;
+    }
+
+} /* namespace dvfs */
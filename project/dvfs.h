@@ -0,0 +1,86 @@
+#ifndef __DVFS_H__
+#define __DVFS_H__
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MyAllocator.h"
+
+namespace dvfs {
+
+/* Root of the cpufreq sysfs tree, CPUFREQ_ROOT or /sys/devices/system/cpu. */
+    std::string cpufreq_root();
+
+/* \brief Sets the core frequency of the program's CPUs per region
+ *
+ * Regions whose predicted cache misses per instruction stay below a threshold
+ * are compute-bound and run at the maximum frequency. Above it, the frequency
+ * goes down with the miss ratio, as far as the energy model does not predict
+ * more energy for the lower frequency. Frequencies are written through
+ * scaling_setspeed if the CPU uses the userspace governor, otherwise through
+ * scaling_max_freq. A new frequency is only written once a region chose it
+ * for 'hold' of its entries in a row, counted per region so that regions which
+ * alternate do not reset each other, and then for all CPUs at once. The
+ * original settings are written back by restore(). */
+    class FrequencyGovernor {
+    public:
+        /* Predicts the energy of the region at the given frequency in kHz, false if there is no prediction. */
+        using Energy = std::function<bool(unsigned long khz, double &energy)>;
+
+    private:
+        struct Cpu {
+            int id;
+            std::string file;       // scaling_setspeed or scaling_max_freq
+            std::string original;   // content of the file before the first change
+        };
+
+        struct Streak {
+            unsigned long khz = 0;  // frequency the region chose on its last entries
+            unsigned int count = 0; // entries in a row it chose it
+        };
+
+        std::mutex _lock;           // regions may be started from several threads when nested
+        std::string _root;
+        std::vector<Cpu> _cpus;
+        std::vector<unsigned long> _frequencies;    // available frequencies in kHz, ascending
+        double _threshold;          // misses per instruction above which a region counts as memory-bound
+        unsigned int _hold;
+        unsigned long _current;     // frequency that is set now, 0 if unknown
+        unsigned long _nominal;     // frequency that was set before the first change
+        bool _changed;              // whether anything was written, i.e. there is something to restore
+        InternalMap<const void *, Streak> _streaks;     // hysteresis per region, grows while regions run
+
+        bool write(const std::string &file, const std::string &value);
+
+    public:
+        FrequencyGovernor(std::string root, std::vector<int> cpus, double threshold, unsigned int hold);
+
+        ~FrequencyGovernor();
+
+        /* Reads DVFS, DVFS_MISS_RATIO and DVFS_HOLD for the CPUs the process may run on,
+         * nullptr if DVFS is not set or cpufreq is not available. */
+        static std::unique_ptr<FrequencyGovernor> from_env();
+
+        bool usable() const { return !_cpus.empty() && !_frequencies.empty(); }
+
+        /* Chooses the frequency for a region from its predicted miss ratio. */
+        unsigned long choose(double miss_ratio, const Energy &energy) const;
+
+        /* The frequency the CPUs ran at before the governor, for regions without a model yet. */
+        unsigned long nominal() const { return _nominal; }
+
+        /* Requests the frequency for the entry of the region that starts next, returns true if it was written. */
+        bool apply(const void *region, unsigned long khz);
+
+        /* Writes the original settings back. */
+        void restore();
+    };
+
+} /* namespace dvfs */
+
+#endif /* __DVFS_H__ */
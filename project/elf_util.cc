@@ -0,0 +1,256 @@
+#include "elf_util.h"
+#include "debug_util.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <mutex>
+
+#include <link.h>       // dl_iterate_phdr
+#include <elf.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace elf_util {
+
+    struct search {
+        uintptr_t addr;
+        std::optional<Module> result;
+    };
+
+    static std::string read_build_id(struct dl_phdr_info *info) {
+        for (int i = 0; i < info->dlpi_phnum; i++) {
+            const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type != PT_NOTE)
+                continue;
+
+            /* Walk the notes of this segment, each one is padded to 4 bytes */
+            auto note = reinterpret_cast<const char *>(info->dlpi_addr + phdr.p_vaddr);
+            auto end = note + phdr.p_memsz;
+            while (note + sizeof(ElfW(Nhdr)) <= end) {
+                auto nhdr = reinterpret_cast<const ElfW(Nhdr) *>(note);
+                auto name = note + sizeof(ElfW(Nhdr));
+                auto desc = name + ((nhdr->n_namesz + 3) & ~3u);
+
+                if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && memcmp(name, "GNU", 4) == 0) {
+                    std::string hex;
+                    char byte[3];
+                    for (unsigned int b = 0; b < nhdr->n_descsz; b++) {
+                        snprintf(byte, sizeof(byte), "%02x", (unsigned char) desc[b]);
+                        hex += byte;
+                    }
+                    return hex;
+                }
+
+                note = desc + ((nhdr->n_descsz + 3) & ~3u);
+            }
+        }
+
+        return {};
+    }
+
+    static int find_module(struct dl_phdr_info *info, size_t, void *data) {
+        auto s = static_cast<struct search *>(data);
+
+        for (int i = 0; i < info->dlpi_phnum; i++) {
+            const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type != PT_LOAD)
+                continue;
+
+            uintptr_t start = info->dlpi_addr + phdr.p_vaddr;
+            if (s->addr >= start && s->addr < start + phdr.p_memsz) {
+                std::string path = info->dlpi_name;
+                /* The main executable is reported with an empty name */
+                if (path.empty()) {
+                    std::error_code ec;
+                    path = std::filesystem::read_symlink("/proc/self/exe", ec).string();
+                }
+
+                s->result = Module{path, read_build_id(info), info->dlpi_addr};
+                return 1;   // stop iterating
+            }
+        }
+
+        return 0;
+    }
+
+    std::optional<Module> module_of(const void *addr) {
+        struct search s{reinterpret_cast<uintptr_t>(addr), std::nullopt};
+        dl_iterate_phdr(find_module, &s);
+        return s.result;
+    }
+
+    std::string stable_key(const void *addr) {
+        static std::mutex lock;
+        static std::map<const void *, std::string> cache;
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (auto it = cache.find(addr); it != cache.end())
+            return it->second;
+
+        std::string key;
+        if (auto module = module_of(addr)) {
+            std::string id = module->build_id;
+            if (id.empty()) {
+                LOGGER->warning("No build-id for %s, falling back to the file name\n", module->path.c_str());
+                id = std::filesystem::path(module->path).filename().string();
+            }
+
+            char offset[32];
+            snprintf(offset, sizeof(offset), "+%lx", reinterpret_cast<uintptr_t>(addr) - module->base);
+            key = id + offset;
+        } else {
+            LOGGER->warning("Address %p does not belong to any loaded object\n", addr);
+            char raw[32];
+            snprintf(raw, sizeof(raw), "%p", addr);
+            key = raw;
+        }
+
+        cache[addr] = key;
+        return key;
+    }
+
+    std::vector<Symbol> read_symbols(const Module &module) {
+        std::vector<Symbol> symbols;
+
+        int fd = open(module.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return symbols;
+        struct stat st;
+        if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(ElfW(Ehdr))) {
+            close(fd);
+            return symbols;
+        }
+        size_t size = st.st_size;
+        void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            return symbols;
+
+        auto base = static_cast<const char *>(map);
+        auto ehdr = reinterpret_cast<const ElfW(Ehdr) *>(base);
+        bool valid = memcmp(ehdr->e_ident, ELFMAG, SELFMAG) == 0 && ehdr->e_shoff != 0 &&
+                     ehdr->e_shentsize == sizeof(ElfW(Shdr)) &&
+                     ehdr->e_shoff + ehdr->e_shnum * sizeof(ElfW(Shdr)) <= size;
+        if (!valid) {
+            LOGGER->warning("Cannot read the sections of %s\n", module.path.c_str());
+            munmap(map, size);
+            return symbols;
+        }
+
+        auto shdrs = reinterpret_cast<const ElfW(Shdr) *>(base + ehdr->e_shoff);
+        const ElfW(Shdr) *symtab = nullptr;
+        for (int i = 0; i < ehdr->e_shnum; i++) {
+            if (shdrs[i].sh_type == SHT_SYMTAB || (shdrs[i].sh_type == SHT_DYNSYM && !symtab))
+                symtab = &shdrs[i];
+        }
+
+        if (symtab && symtab->sh_link < ehdr->e_shnum && symtab->sh_offset + symtab->sh_size <= size) {
+            const ElfW(Shdr) &strtab = shdrs[symtab->sh_link];
+            auto syms = reinterpret_cast<const ElfW(Sym) *>(base + symtab->sh_offset);
+            size_t count = symtab->sh_size / sizeof(ElfW(Sym));
+            for (size_t i = 0; i < count; i++) {
+                const ElfW(Sym) &sym = syms[i];
+                int type = ELF64_ST_TYPE(sym.st_info);
+                if ((type != STT_FUNC && type != STT_OBJECT) || sym.st_shndx == SHN_UNDEF || sym.st_size == 0)
+                    continue;
+                if (strtab.sh_offset + sym.st_name >= size)
+                    continue;
+                const char *name = base + strtab.sh_offset + sym.st_name;
+                bool data = type == STT_OBJECT && sym.st_shndx < ehdr->e_shnum &&
+                            (shdrs[sym.st_shndx].sh_flags & SHF_WRITE);
+                symbols.push_back({std::string(name, strnlen(name, size - strtab.sh_offset - sym.st_name)),
+                                   module.base + sym.st_value, sym.st_size, data});
+            }
+        }
+
+        munmap(map, size);
+        std::sort(symbols.begin(), symbols.end(), [](const Symbol &a, const Symbol &b) { return a.start < b.start; });
+        return symbols;
+    }
+
+    static int add_module(struct dl_phdr_info *info, size_t, void *data) {
+        auto modules = static_cast<std::vector<Module> *>(data);
+        std::string path = info->dlpi_name;
+        if (path.empty() && !modules->empty())
+            return 0;   // the vdso, it has no file
+        if (path.empty()) {
+            std::error_code ec;
+            path = std::filesystem::read_symlink("/proc/self/exe", ec).string();
+        }
+        modules->push_back({path, read_build_id(info), info->dlpi_addr});
+        return 0;
+    }
+
+    std::vector<Module> loaded_modules() {
+        std::vector<Module> modules;
+        dl_iterate_phdr(add_module, &modules);
+        return modules;
+    }
+
+    StaticData StaticData::of_loaded_modules(size_t min_size) {
+        StaticData index;
+        auto own = module_of(reinterpret_cast<const void *>(&loaded_modules));
+        for (const Module &module: loaded_modules()) {
+            if (own && module.path == own->path)
+                continue;   // the objects of my_omp.so are not the program's
+            for (const Symbol &symbol: read_symbols(module))
+                if (symbol.data && symbol.size >= min_size)
+                    index.objects.push_back({symbol.start, symbol.size});
+        }
+
+        std::sort(index.objects.begin(), index.objects.end(), [](const Object &a, const Object &b) { return a.start < b.start; });
+        /* Aliases and objects inside others (a variable of a common block with a symbol of its own) merge into the outer one */
+        std::vector<Object> merged;
+        for (const Object &object: index.objects) {
+            if (!merged.empty() && object.start < merged.back().start + merged.back().size) {
+                Object &outer = merged.back();
+                outer.size = std::max(outer.size, object.start + object.size - outer.start);
+            } else {
+                merged.push_back(object);
+            }
+        }
+        index.objects = std::move(merged);
+        return index;
+    }
+
+    size_t StaticData::bytes_from(uintptr_t address) const {
+        auto next = std::upper_bound(objects.begin(), objects.end(), address,
+                                     [](uintptr_t a, const Object &o) { return a < o.start; });
+        if (next == objects.begin())
+            return 0;
+        const Object &object = *std::prev(next);
+        return address < object.start + object.size ? object.start + object.size - address : 0;
+    }
+
+    std::optional<Symbol> symbol_of(const void *addr) {
+        static std::mutex lock;
+        static std::map<std::string, std::vector<Symbol>> cache;    // module path -> its symbols
+
+        auto module = module_of(addr);
+        if (!module)
+            return std::nullopt;
+
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = cache.find(module->path);
+        if (it == cache.end())
+            it = cache.emplace(module->path, read_symbols(*module)).first;
+
+        /* Last symbol starting at or before the address */
+        auto a = reinterpret_cast<uintptr_t>(addr);
+        auto &symbols = it->second;
+        auto next = std::upper_bound(symbols.begin(), symbols.end(), a,
+                                     [](uintptr_t a, const Symbol &s) { return a < s.start; });
+        if (next == symbols.begin())
+            return std::nullopt;
+        auto &symbol = *std::prev(next);
+        if (a >= symbol.start + symbol.size)
+            return std::nullopt;
+        return symbol;
+    }
+
+} /* namespace elf_util */
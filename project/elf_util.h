@@ -0,0 +1,72 @@
+#ifndef __ELF_UTIL_H__
+#define __ELF_UTIL_H__
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace elf_util {
+
+/* \brief A loaded ELF object (executable or shared library) */
+    struct Module {
+        std::string path;       // path of the object, the main executable is resolved via /proc/self/exe
+        std::string build_id;   // hex string of the GNU build-id note, empty if the object has none
+        uintptr_t base;         // load bias, 0 for non-PIE executables
+    };
+
+/* Finds the loaded object one of whose segments contains the given address. */
+    std::optional<Module> module_of(const void *addr);
+
+/* A key for code at the given address that stays the same across runs of the same binary,
+ * i.e. independent of ASLR: "<build-id>+<offset in module>". Objects without a build-id
+ * are identified by their file name instead. */
+    std::string stable_key(const void *addr);
+
+/* \brief A function or data object from the symbol table of a loaded object */
+    struct Symbol {
+        std::string name;
+        uintptr_t start;        // run-time address
+        size_t size;
+        bool data = false;      // an object in a writable section (.data, .bss), not code or constants
+    };
+
+/* Reads the function and object symbols of a module from its file, sorted by address.
+ * The full .symtab is used if the file still has one, otherwise the .dynsym. */
+    std::vector<Symbol> read_symbols(const Module &module);
+
+/* All loaded objects, the main executable first. */
+    std::vector<Module> loaded_modules();
+
+/* \brief Interval index of the static data objects of the loaded objects
+ *
+ * Arrays in .data and .bss (globals, Fortran common blocks and module
+ * variables) never go through malloc, this finds the object an address
+ * points into instead. Built once from the symbol tables, lookups do not
+ * allocate and need no lock. Objects loaded later are not in it. */
+    class StaticData {
+        struct Object {
+            uintptr_t start;
+            size_t size;
+        };
+        std::vector<Object> objects;    // sorted by start, without overlaps
+
+    public:
+        /* Indexes the data objects of at least min_size bytes of all loaded objects except the one of my_omp.so. */
+        static StaticData of_loaded_modules(size_t min_size);
+
+        /* Bytes from the address to the end of the object it points into, 0 if it points into none. */
+        size_t bytes_from(uintptr_t address) const;
+
+        size_t size() const { return objects.size(); }
+    };
+
+/* Finds the symbol that contains the given address, e.g. to get the size of an outlined
+ * OpenMP function. The symbols of each module are read once and then kept. */
+    std::optional<Symbol> symbol_of(const void *addr);
+
+} /* namespace elf_util */
+
+#endif /* __ELF_UTIL_H__ */
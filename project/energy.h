@@ -37,6 +37,7 @@ namespace energy {
 
         ~PerfMeasure();
 
+        /* Safe to call from several threads at once, it only reads the fd. */
         uint64_t read();
     };
 
@@ -0,0 +1,26 @@
+#ifndef __FEATURE_MAP_H__
+#define __FEATURE_MAP_H__
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "MyAllocator.h"
+
+// where the metrics of a function come from: each slot is a word in the function's data block that points to an array
+struct FeatureMap {
+    InternalVector<long> offsets;   // position of the pointer in the data block, one per slot
+    InternalVector<bool> pruned;    // slots that llsp always dropped, they are no longer extracted
+    unsigned int scans = 0;         // searches of the data block done so far
+};
+
+// address -> size of the blocks malloc returned, guarded by map_lock
+extern InternalMap<long long, size_t> malloc_map;
+extern std::mutex map_lock;
+
+// gives the arrays found in the data block of a function the free slots
+void discover_features(FeatureMap &features, void *data);
+
+#endif /* __FEATURE_MAP_H__ */
@@ -0,0 +1,177 @@
+#include "governor.h"
+#include "debug_util.h"
+#include "string_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+namespace governor {
+
+    double score(Objective objective, const Cost &cost) {
+        switch (objective) {
+            case TIME:
+                return cost.time;
+            case ENERGY:
+                return cost.energy;
+            case EDP:
+                return cost.energy * cost.time;
+        }
+        return 0.0;
+    }
+
+    bool parse_objective(const char *name, Objective &objective) {
+        if (strcmp(name, "time") == 0)
+            objective = TIME;
+        else if (strcmp(name, "energy") == 0)
+            objective = ENERGY;
+        else if (strcmp(name, "edp") == 0)
+            objective = EDP;
+        else
+            return false;
+        return true;
+    }
+
+    void Scaling::basis(double threads, double *b) {
+        b[0] = 1.0;
+        b[1] = 1.0 / threads;
+        b[2] = threads;
+    }
+
+    void Scaling::add(unsigned int threads, const Cost &cost) {
+        double b[3];
+        basis(threads, b);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++)
+                _gram[i][j] += b[i] * b[j];
+            _time[i] += b[i] * cost.time;
+            _energy[i] += b[i] * cost.energy;
+        }
+    }
+
+    static double determinant(const double m[3][3]) {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+               - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+               + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+
+    static void solve(const double gram[3][3], double det, const double *rhs, double *x) {   // Cramer's rule
+        for (int k = 0; k < 3; k++) {
+            double m[3][3];
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++)
+                    m[i][j] = j == k ? rhs[i] : gram[i][j];
+            x[k] = determinant(m) / det;
+        }
+    }
+
+    bool Scaling::evaluate(unsigned int threads, Cost &cost) const {
+        double det = determinant(_gram);
+        double scale = _gram[0][0] * _gram[1][1] * _gram[2][2];
+        if (scale <= 0.0 || std::fabs(det) < 1e-9 * scale)    // fewer than three different thread counts
+            return false;
+
+        double time[3], energy[3], b[3];
+        solve(_gram, det, _time, time);
+        solve(_gram, det, _energy, energy);
+        basis(threads, b);
+        cost.time = time[0] * b[0] + time[1] * b[1] + time[2] * b[2];
+        cost.energy = energy[0] * b[0] + energy[1] * b[1] + energy[2] * b[2];
+        return true;
+    }
+
+    ThreadGovernor::ThreadGovernor(Objective objective, std::vector<unsigned int> candidates, unsigned int explore_every)
+            : _objective{objective}, _candidates{std::move(candidates)}, _explore_every{explore_every} {
+        std::sort(_candidates.begin(), _candidates.end());
+        _candidates.erase(std::unique(_candidates.begin(), _candidates.end()), _candidates.end());
+    }
+
+    std::unique_ptr<ThreadGovernor> ThreadGovernor::from_env(unsigned int max_threads) {
+        const char *name = getenv("GOVERNOR");
+        if (!name)
+            return nullptr;
+
+        Objective objective;
+        if (!parse_objective(name, objective)) {
+            LOGGER->error("Unknown GOVERNOR %s, expected time, energy or edp\n", name);
+            return nullptr;
+        }
+
+        std::vector<unsigned int> candidates;
+        if (const char *list = getenv("GOVERNOR_THREADS")) {
+            for (auto &value: string_util::split(list, ',')) {
+                int threads = atoi(value.c_str());
+                if (threads > 0) candidates.push_back(threads);
+            }
+        } else {
+            for (unsigned int threads = 1; threads < max_threads; threads *= 2)
+                candidates.push_back(threads);
+            candidates.push_back(std::max(max_threads, 1u));
+        }
+        if (candidates.empty()) {
+            LOGGER->error("No thread counts for the governor\n");
+            return nullptr;
+        }
+
+        unsigned int explore_every = getenv("GOVERNOR_EXPLORE") ? atoi(getenv("GOVERNOR_EXPLORE")) : 10;
+
+        LOGGER->info("Thread governor for %s with %lu candidates\n", name, candidates.size());
+        return std::make_unique<ThreadGovernor>(objective, std::move(candidates), explore_every);
+    }
+
+    ThreadGovernor::Decision ThreadGovernor::choose(const void *region, unsigned int requested, bool trained,
+                                                    const Predict &predict) {
+        uint64_t call;
+        size_t explore = _candidates.size();
+        Scaling scaling;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            Region &r = _regions[region];
+            call = r.calls++;
+            if (trained && _explore_every > 0 && call % _explore_every == 0) {
+                explore = r.next_candidate;
+                r.next_candidate = (r.next_candidate + 1) % _candidates.size();
+            }
+            scaling = r.scaling;
+        }
+
+        if (!trained)
+            return {requested, false, 0.0};
+        if (explore < _candidates.size())
+            return {_candidates[explore], true, 0.0};
+
+        // the model knows the inputs of this call, the fit how the cost changes with the thread count
+        Cost base, base_fit;
+        bool shaped = scaling.evaluate(requested, base_fit) && base_fit.time > 0.0 && base_fit.energy > 0.0
+                      && predict(requested, base);
+
+        Decision best{requested, false, std::numeric_limits<double>::infinity()};
+        for (unsigned int threads: _candidates) {
+            Cost cost, fit;
+            if (shaped && scaling.evaluate(threads, fit)) {
+                cost.time = base.time * std::max(fit.time, 0.0) / base_fit.time;
+                cost.energy = base.energy * std::max(fit.energy, 0.0) / base_fit.energy;
+            } else if (!predict(threads, cost)) {
+                continue;
+            }
+            double s = score(_objective, cost);
+            if (s < best.score) {
+                best.threads = threads;
+                best.score = s;
+            }
+        }
+        if (best.score == std::numeric_limits<double>::infinity())
+            best.score = 0.0;
+        return best;
+    }
+
+    void ThreadGovernor::feed(const void *region, unsigned int threads, const Cost &cost) {
+        if (threads == 0)
+            return;
+        std::lock_guard<std::mutex> guard(_lock);
+        _regions[region].scaling.add(threads, cost);
+    }
+
+} /* namespace governor */
@@ -0,0 +1,108 @@
+#ifndef __GOVERNOR_H__
+#define __GOVERNOR_H__
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "MyAllocator.h"
+
+namespace governor {
+
+    enum Objective {
+        TIME   = 0,     // minimum run time
+        ENERGY = 1,     // minimum energy
+        EDP    = 2      // minimum energy-delay product
+    };
+
+/* \brief Predicted cost of running a region with a given setting */
+    struct Cost {
+        double time;    // run time or a proxy for it, only compared between settings of the same region
+        double energy;
+    };
+
+    double score(Objective objective, const Cost &cost);
+
+    /* Parses time, energy or edp, false for anything else. */
+    bool parse_objective(const char *name, Objective &objective);
+
+/* \brief Least-squares fit of the cost of a region over its thread count
+ *
+ * Time and energy are fitted as a + b / threads + c * threads: the parallel
+ * part shrinks with the team (Amdahl), starting and synchronizing the team
+ * grows with it. Unlike a term linear in the thread count, the fit can have
+ * its minimum between the smallest and the largest thread count. */
+    class Scaling {
+    private:
+        double _gram[3][3] = {};    // sums of the products of the basis functions
+        double _time[3] = {};       // sums of the basis functions times the cost
+        double _energy[3] = {};
+
+        static void basis(double threads, double *b);
+
+    public:
+        void add(unsigned int threads, const Cost &cost);
+
+        /* False until calls with at least three different thread counts were added. */
+        bool evaluate(unsigned int threads, Cost &cost) const;
+    };
+
+/* \brief Picks the thread count of each region from the predictions of its model
+ *
+ * The region's model predicts the cost for the thread count the program asked
+ * for, the thread counts seen so far for the region (see feed()) give the
+ * shape of the cost over the thread count, see Scaling. Every candidate is
+ * evaluated with both and the one with the best predicted objective is used;
+ * until the shape is known, the model predicts each candidate on its own.
+ * Regions with too few samples keep the thread count the program asked for.
+ * To learn about the other thread counts, every explore_every-th call of a
+ * region runs with the next candidate in turn instead. */
+    class ThreadGovernor {
+    public:
+        /* Predicts the cost of the region with the given number of threads, false if there is no prediction. */
+        using Predict = std::function<bool(unsigned int threads, Cost &cost)>;
+
+        struct Decision {
+            unsigned int threads;
+            bool explored;
+            double score;       // predicted objective of the chosen thread count, 0 if exploring
+        };
+
+    private:
+        struct Region {
+            uint64_t calls = 0;
+            size_t next_candidate = 0;  // the candidate the next exploration uses
+            Scaling scaling;
+        };
+
+        Objective _objective;
+        std::vector<unsigned int> _candidates;
+        unsigned int _explore_every;
+        std::mutex _lock;
+        InternalMap<const void *, Region> _regions;     // grows while regions run, so it lives in the arena
+
+    public:
+        ThreadGovernor(Objective objective, std::vector<unsigned int> candidates, unsigned int explore_every);
+
+        /* Reads GOVERNOR (time, energy or edp), GOVERNOR_THREADS and GOVERNOR_EXPLORE,
+         * nullptr if GOVERNOR is not set. Without GOVERNOR_THREADS, the candidates are
+         * the powers of two up to max_threads and max_threads itself. */
+        static std::unique_ptr<ThreadGovernor> from_env(unsigned int max_threads);
+
+        Objective objective() const { return _objective; }
+
+        /* Chooses the thread count for a call of the region that asked for 'requested' threads. */
+        Decision choose(const void *region, unsigned int requested, bool trained, const Predict &predict);
+
+        /* Adds the measured cost of a call of the region that ran with the given number of threads. */
+        void feed(const void *region, unsigned int threads, const Cost &cost);
+    };
+
+} /* namespace governor */
+
+#endif /* __GOVERNOR_H__ */
@@ -0,0 +1,226 @@
+#include "graybox.h"
+#include "graybox_table.h"
+#include "debug_util.h"
+#include "MyAllocator.h"
+
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+#define GRAYBOX_REGIONS 1024    // slots of the region table, a power of two
+#define GRAYBOX_ALPHA 0.1       // weight of the newest error in the rolling means
+#define EPSILON 1E-10           // same as llsp_predict
+
+namespace graybox {
+
+    struct Slot {
+        std::atomic<void (*)(void *)> fn{nullptr};
+        std::atomic<uint64_t> seq{0};
+
+        /* written under seq */
+        bool has_model = false;
+        std::vector<double> coefficients;   // events x metrics
+        std::vector<double> fallback;
+        double weight = 1.0;                // of the region's own model, the rest is the global model
+        std::vector<double> global;         // events x metrics
+        std::vector<double> bias;
+        std::vector<graybox_error_t> errors;
+    };
+
+    /* what a query copies out of a slot, in the arena: the threads that query are the program's */
+    struct Model {
+        InternalVector<double> coefficients, fallback, global, bias;
+        double weight;
+    };
+
+    static size_t metric_count = 0;
+    static std::vector<std::string> events __attribute__ ((init_priority(101)));
+    static std::unique_ptr<Slot[]> slots __attribute__ ((init_priority(101)));
+
+    static size_t home(void (*fn)(void *)) {
+        auto key = reinterpret_cast<uintptr_t>(fn);
+        return (key ^ (key >> 12)) & (GRAYBOX_REGIONS - 1);
+    }
+
+    static Slot *find(void (*fn)(void *)) {
+        if (!slots) return nullptr;
+        for (size_t i = 0, index = home(fn); i < GRAYBOX_REGIONS; i++, index = (index + 1) & (GRAYBOX_REGIONS - 1)) {
+            auto current = slots[index].fn.load(std::memory_order_acquire);
+            if (current == fn) return &slots[index];
+            if (current == nullptr) return nullptr;
+        }
+        return nullptr;
+    }
+
+    static void write_begin(Slot &slot) {
+        uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+        while ((seq & 1) || !slot.seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire,
+                                                            std::memory_order_relaxed))
+            seq = slot.seq.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void write_end(Slot &slot) {
+        slot.seq.fetch_add(1, std::memory_order_release);
+    }
+
+    template<typename Copy>
+    static void read(const Slot &slot, Copy copy) {
+        while (true) {
+            uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq & 1) continue;  // a publish is halfway
+            copy();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == seq) return;
+        }
+    }
+
+    void init(size_t metrics, std::vector<std::string> event_names) {
+        metric_count = metrics;
+        events = std::move(event_names);
+        slots = std::make_unique<Slot[]>(GRAYBOX_REGIONS);
+        for (size_t i = 0; i < GRAYBOX_REGIONS; i++) {
+            slots[i].coefficients.resize(events.size() * metrics);
+            slots[i].fallback.resize(events.size());
+            slots[i].global.resize(events.size() * metrics);
+            slots[i].bias.resize(events.size());
+            slots[i].errors.resize(events.size());
+        }
+    }
+
+    bool add(void (*fn)(void *)) {
+        if (!slots) return false;
+        for (size_t i = 0, index = home(fn); i < GRAYBOX_REGIONS; i++, index = (index + 1) & (GRAYBOX_REGIONS - 1)) {
+            void (*expected)(void *) = nullptr;
+            if (slots[index].fn.compare_exchange_strong(expected, fn, std::memory_order_acq_rel) || expected == fn)
+                return true;
+        }
+        LOGGER->warning("The graybox region table is full, the region cannot be queried\n");
+        return false;
+    }
+
+    void publish(void (*fn)(void *), const double *const *coefficients, const double *fallback, const Blend &blend) {
+        Slot *slot = find(fn);
+        if (!slot) return;
+
+        write_begin(*slot);
+        for (size_t e = 0; e < events.size(); e++) {
+            if (coefficients[e])
+                std::copy(coefficients[e], coefficients[e] + metric_count, slot->coefficients.begin() + e * metric_count);
+            slot->fallback[e] = fallback[e];
+            if (blend.coefficients && blend.coefficients[e]) {
+                std::copy(blend.coefficients[e], blend.coefficients[e] + metric_count, slot->global.begin() + e * metric_count);
+                slot->bias[e] = blend.bias[e];
+            }
+        }
+        slot->weight = blend.coefficients ? blend.weight : 1.0;
+        slot->has_model = true;
+        write_end(*slot);
+    }
+
+    void record(void (*fn)(void *), const double *predicted, const double *measured) {
+        Slot *slot = find(fn);
+        if (!slot) return;
+
+        write_begin(*slot);
+        for (size_t e = 0; e < events.size(); e++) {
+            graybox_error_t &error = slot->errors[e];
+            double absolute = std::fabs(predicted[e] - measured[e]);
+            double weight = error.samples == 0 ? 1.0 : GRAYBOX_ALPHA;
+            error.mean_absolute += weight * (absolute - error.mean_absolute);
+            if (measured[e] != 0)
+                error.mean_relative += weight * (absolute / std::fabs(measured[e]) - error.mean_relative);
+            error.last_absolute = absolute;
+            error.samples++;
+        }
+        write_end(*slot);
+    }
+
+} /* namespace graybox */
+
+using namespace graybox;
+
+static double dot(const double *coefficients, const double *metrics) {
+    double sum = 0.0;
+#pragma omp simd reduction(+:sum)
+    for (size_t i = 0; i < metric_count; i++)
+        sum += coefficients[i] * metrics[i];
+    return sum;
+}
+
+static Slot *slot_of(graybox_region_t region) {
+    if (!slots || region < 0 || region >= GRAYBOX_REGIONS) return nullptr;
+    Slot *slot = &slots[region];
+    return slot->fn.load(std::memory_order_acquire) ? slot : nullptr;
+}
+
+extern "C" size_t graybox_metric_count(void) {
+    return metric_count;
+}
+
+extern "C" size_t graybox_event_count(void) {
+    return events.size();
+}
+
+extern "C" const char *graybox_event_name(size_t event) {
+    return event < events.size() ? events[event].c_str() : nullptr;
+}
+
+extern "C" graybox_region_t graybox_region(void (*fn)(void *)) {
+    Slot *slot = find(fn);
+    return slot ? slot - slots.get() : GRAYBOX_EUNKNOWN;
+}
+
+extern "C" int graybox_predict(graybox_region_t region, const double *metrics, double *predicted) {
+    return graybox_predict_batch(region, metrics, 1, predicted);
+}
+
+extern "C" int graybox_predict_batch(graybox_region_t region, const double *metrics, size_t count, double *predicted) {
+    Slot *slot = slot_of(region);
+    if (!slot) return GRAYBOX_EUNKNOWN;
+    if (!metrics || !predicted) return GRAYBOX_EINVAL;
+
+    /* one consistent copy of the model for the whole batch, the buffers are allocated once per thread */
+    thread_local Model model;
+    model.coefficients.resize(slot->coefficients.size());
+    model.fallback.resize(slot->fallback.size());
+    model.global.resize(slot->global.size());
+    model.bias.resize(slot->bias.size());
+    bool has_model;
+    read(*slot, [&]() {
+        has_model = slot->has_model;
+        model.weight = slot->weight;
+        std::copy(slot->coefficients.begin(), slot->coefficients.end(), model.coefficients.begin());
+        std::copy(slot->fallback.begin(), slot->fallback.end(), model.fallback.begin());
+        if (model.weight < 1.0) {
+            std::copy(slot->global.begin(), slot->global.end(), model.global.begin());
+            std::copy(slot->bias.begin(), slot->bias.end(), model.bias.begin());
+        }
+    });
+    if (!has_model) return GRAYBOX_ENOMODEL;
+
+    const size_t nr_events = model.fallback.size();
+    for (size_t c = 0; c < count; c++) {
+        const double *vector = metrics + c * metric_count;
+        for (size_t e = 0; e < nr_events; e++) {
+            double own = dot(model.coefficients.data() + e * metric_count, vector);
+            own = own >= EPSILON ? own : model.fallback[e];
+            if (model.weight < 1.0) {   // as my_omp blends in the global model for regions with few samples
+                double global = model.bias[e] + dot(model.global.data() + e * metric_count, vector);
+                global = global >= EPSILON ? global : model.fallback[e];
+                own = model.weight * own + (1.0 - model.weight) * global;
+            }
+            predicted[c * nr_events + e] = own;
+        }
+    }
+    return GRAYBOX_OK;
+}
+
+extern "C" int graybox_error_stats(graybox_region_t region, size_t event, graybox_error_t *stats) {
+    Slot *slot = slot_of(region);
+    if (!slot || event >= events.size()) return GRAYBOX_EUNKNOWN;
+    if (!stats) return GRAYBOX_EINVAL;
+
+    read(*slot, [&]() { *stats = slot->errors[event]; });
+    return GRAYBOX_OK;
+}
@@ -0,0 +1,65 @@
+#ifndef __GRAYBOX_H__
+#define __GRAYBOX_H__
+
+#pragma once
+
+/* Query API of my_omp.so for applications and schedulers that run with it preloaded.
+ *
+ * Regions are the outlined functions of parallel regions, they are known once
+ * they ran for the first time. Predictions come from the llsp model of the
+ * region as of its last solve, for the events in the order of
+ * graybox_event_name(). While a region has fewer than GLOBAL_BLEND samples,
+ * the global model is blended in as for the predictions of my_omp itself, as
+ * it was at the region's last call and with that call's loop trip count. None of the functions block the parallel regions of
+ * the program, they can be called from any thread at any time. Look up the
+ * functions with dlsym(RTLD_DEFAULT, ...) to not depend on the preload. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GRAYBOX_OK        0
+#define GRAYBOX_EUNKNOWN (-1)     /* no such region or event */
+#define GRAYBOX_ENOMODEL (-2)     /* the region has no llsp model yet, or another predictor is used */
+#define GRAYBOX_EINVAL   (-3)     /* a pointer or size argument is invalid */
+
+typedef int64_t graybox_region_t;
+
+/* Rolling error of the predictions of one event of a region against its measurements. */
+typedef struct graybox_error {
+    uint64_t samples;           /* predictions compared so far */
+    double mean_absolute;       /* exponentially weighted mean of |predicted - measured| */
+    double mean_relative;       /* the same relative to the measurement, measurements of 0 are left out */
+    double last_absolute;       /* error of the most recent prediction */
+} graybox_error_t;
+
+/* Number of metrics per metric vector, see the README for their layout. */
+size_t graybox_metric_count(void);
+
+/* Number of predicted events, and the name of each. */
+size_t graybox_event_count(void);
+
+const char *graybox_event_name(size_t event);
+
+/* Handle of the region of the given outlined function, GRAYBOX_EUNKNOWN if it did not run yet. */
+graybox_region_t graybox_region(void (*fn)(void *));
+
+/* Predicts all events for one metric vector, predicted needs room for graybox_event_count() values. */
+int graybox_predict(graybox_region_t region, const double *metrics, double *predicted);
+
+/* Predicts all events for count metric vectors stored one after the other, e.g. the same vector with
+ * different thread counts. The predictions are stored the same way, graybox_event_count() per vector,
+ * and all of them come from the same model. */
+int graybox_predict_batch(graybox_region_t region, const double *metrics, size_t count, double *predicted);
+
+/* Error statistics of the predictions of one event of the region. */
+int graybox_error_stats(graybox_region_t region, size_t event, graybox_error_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GRAYBOX_H__ */
@@ -0,0 +1,43 @@
+#ifndef __GRAYBOX_TABLE_H__
+#define __GRAYBOX_TABLE_H__
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/* \brief The side of the graybox_* API that my_omp feeds
+ *
+ * Every region has a fixed slot in an open addressing table that is only
+ * ever added to, so lookups need no lock. The model of a slot is published
+ * under a sequence counter: the region that runs bumps it to odd, writes the
+ * coefficients, and bumps it to even again, readers retry if it changed while
+ * they copied. Only the publishing side ever waits, and only for another
+ * publisher of the same region. */
+namespace graybox {
+
+    /* Sizes the table, before any other call. */
+    void init(size_t metrics, std::vector<std::string> event_names);
+
+    /* Makes the region queryable, false if the table is full. */
+    bool add(void (*fn)(void *));
+
+    /* The part of the global model a region with few samples still leans on: predictions are
+     * weight * own + (1 - weight) * (bias + coefficients . metrics), each part falling back on its own. */
+    struct Blend {
+        double weight = 1.0;                            // of the region's own model
+        const double *const *coefficients = nullptr;   // per event, of the global model over the metrics of the region
+        const double *bias = nullptr;                   // per event, the part of the global model the metrics do not change
+    };
+
+    /* Publishes the coefficients of each event's llsp model, and the value llsp_predict falls back to
+     * for predictions below zero. A null coefficient array leaves the model of the slot as it is. */
+    void publish(void (*fn)(void *), const double *const *coefficients, const double *fallback, const Blend &blend);
+
+    /* Compares the measurements of a call that ended against what was predicted for it. */
+    void record(void (*fn)(void *), const double *predicted, const double *measured);
+
+} /* namespace graybox */
+
+#endif /* __GRAYBOX_TABLE_H__ */
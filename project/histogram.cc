@@ -0,0 +1,51 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace histogram {
+
+    Histogram::Histogram() : _buckets{}, _zeros{0}, _count{0}, _max{0.0} {}
+
+    int Histogram::bucket(double value) {
+        int exponent;
+        double mantissa = std::frexp(value, &exponent);     // value = mantissa * 2^exponent, mantissa in [0.5, 1)
+        if (exponent <= MIN_EXPONENT) return 0;
+        if (exponent > MAX_EXPONENT) return BUCKETS - 1;
+        int sub = (int) ((mantissa - 0.5) * 2 * SUB_BUCKETS);
+        return (exponent - MIN_EXPONENT - 1) * SUB_BUCKETS + std::min(sub, SUB_BUCKETS - 1);
+    }
+
+    double Histogram::upper_bound(int bucket) {
+        int exponent = bucket / SUB_BUCKETS + MIN_EXPONENT + 1;
+        int sub = bucket % SUB_BUCKETS;
+        return std::ldexp(0.5 + (sub + 1) * 0.5 / SUB_BUCKETS, exponent);
+    }
+
+    void Histogram::record(double value) {
+        if (value > 0)
+            _buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        else
+            _zeros.fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+
+        double max = _max.load(std::memory_order_relaxed);
+        while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+    }
+
+    double Histogram::percentile(double q) const {
+        uint64_t count = _count.load(std::memory_order_relaxed);
+        if (count == 0) return 0.0;
+
+        auto rank = (uint64_t) std::ceil(q * count);
+        uint64_t seen = _zeros.load(std::memory_order_relaxed);
+        if (seen >= rank) return 0.0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += _buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(upper_bound(i), max());
+        }
+        return max();   // counted, but its bucket was not incremented yet
+    }
+
+} /* namespace histogram */
@@ -0,0 +1,51 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace histogram {
+
+/* \brief Log-bucketed histogram of non-negative values with lock-free updates
+ *
+ * Each power of two between 2^MIN_EXPONENT and 2^MAX_EXPONENT is split into
+ * SUB_BUCKETS linear buckets, like an HDR histogram, so every value is kept
+ * with a relative precision of 1/SUB_BUCKETS whatever its magnitude. That
+ * covers durations in seconds as well as counter values. Values outside the
+ * range are clamped into the first or last bucket, the exact maximum is kept
+ * separately. record() can be called from any thread while others read. */
+    class Histogram {
+    public:
+        static constexpr int MIN_EXPONENT = -32;
+        static constexpr int MAX_EXPONENT = 48;
+        static constexpr int SUB_BUCKETS = 16;
+        static constexpr int BUCKETS = (MAX_EXPONENT - MIN_EXPONENT) * SUB_BUCKETS;
+
+    private:
+        std::atomic<uint64_t> _buckets[BUCKETS];
+        std::atomic<uint64_t> _zeros;       // values <= 0
+        std::atomic<uint64_t> _count;
+        std::atomic<double> _max;
+
+        static int bucket(double value);
+
+        static double upper_bound(int bucket);
+
+    public:
+        Histogram();
+
+        void record(double value);
+
+        uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+
+        double max() const { return _max.load(std::memory_order_relaxed); }
+
+        /* Smallest bucket bound that at least the fraction q of the values are below, at most max(). */
+        double percentile(double q) const;
+    };
+
+} /* namespace histogram */
+
+#endif /* __HISTOGRAM_H__ */
@@ -9,6 +9,7 @@
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <stdint.h>
 
 #include "llsp.h"
 
@@ -30,19 +31,36 @@ struct llsp_s {
     struct matrix sort;      // matrix with to-be-dropped columns shuffled to the right
     struct matrix good;      // reduced matrix with low-contribution columns dropped
     double        last_measured;
+    size_t        solves;    // number of llsp_solve() calls with data
+    struct llsp_drops *drops;  // column dropping statistics per metric
+    struct llsp_params params;
     double        result[];  // the resulting coefficients
 };
 
+static void allocate(llsp_t *llsp);
+static void insert_row(llsp_t *restrict llsp, const double *restrict metrics, double target);
 static void givens_fixup(struct matrix m, size_t row, size_t column);
-static void stabilize(struct matrix *sort, struct matrix *good);
+static void stabilize(struct matrix *sort, struct matrix *good, double contribution);
 static void trisolve(struct matrix m);
+static void count_drops(llsp_t *llsp);
 
 #pragma mark -
 
 
 #pragma mark LLSP API Functions
 
+struct llsp_params llsp_default_params(void)
+{
+    struct llsp_params params = { .aging = AGING_FACTOR, .contribution = COLUMN_CONTRIBUTION };
+    return params;
+}
+
 llsp_t *llsp_new(size_t count)
+{
+    return llsp_new_ex(count, NULL);
+}
+
+llsp_t *llsp_new_ex(size_t count, const struct llsp_params *params)
 {
     llsp_t *llsp;
 
@@ -56,6 +74,7 @@ llsp_t *llsp_new(size_t count)
     llsp->metrics = count;
     llsp->full.columns = count + 1;
     llsp->sort.columns = count + 1;
+    llsp->params = params ? *params : llsp_default_params();
 
     return llsp;
 }
@@ -64,43 +83,17 @@ void llsp_add(llsp_t *restrict llsp, const double *restrict metrics, double targ
 {
     const size_t column_count = llsp->full.columns;
     const size_t row_count = llsp->full.columns + 1;  // extra row for shifting down and trisolve
-    const size_t column_size = row_count * sizeof(double);
-    const size_t data_size = column_count * row_count * sizeof(double);
-    const size_t matrix_size = column_count * sizeof(double *);
-    const size_t index_last = column_count - 1;
-
-    if (!llsp->data) {
-        llsp->data        = malloc(data_size);
-        llsp->full.matrix = malloc(matrix_size);
-        llsp->sort.matrix = malloc(matrix_size);
-        llsp->good.matrix = malloc(matrix_size);
-        if (!llsp->data || !llsp->full.matrix || !llsp->sort.matrix || !llsp->good.matrix)
-            abort();
-
-        for (size_t column = 0; column < llsp->full.columns; column++)
-            llsp->full.matrix[column] =
-            llsp->sort.matrix[column] = llsp->data + column * row_count;
-
-        /* we need an extra column for the column dropping scan */
-        llsp->good.matrix[index_last] = malloc(column_size);
-        if (!llsp->good.matrix[index_last]) abort();
 
-        memset(llsp->data, 0, data_size);
-    }
+    if (!llsp->data) allocate(llsp);
 
     /* age out the past a little bit */
-    for (size_t element = 0; element < row_count * column_count; element++)
-        llsp->data[element] *= 1.0 - AGING_FACTOR;
-
-    /* add new row to the top of the solving matrix */
-    memmove(llsp->data + 1, llsp->data, data_size - sizeof(double));
-    for (size_t column = 0; column < llsp->metrics; column++)
-        llsp->full.matrix[column][0] = metrics[column];
-    llsp->full.matrix[llsp->metrics][0] = target;
+    if (llsp->params.aging != 0.0) {
+        const double keep = 1.0 - llsp->params.aging;
+        for (size_t element = 0; element < row_count * column_count; element++)
+            llsp->data[element] *= keep;
+    }
 
-    /* givens fixup of the subdiagonal */
-    for (size_t i = 0; i < llsp->sort.columns; i++)
-        givens_fixup(llsp->sort, i + 1, i);
+    insert_row(llsp, metrics, target);
 
     llsp->last_measured = target;
 }
@@ -110,8 +103,9 @@ const double *llsp_solve(llsp_t *restrict llsp)
     double *result = NULL;
 
     if (llsp->data) {
-        stabilize(&llsp->sort, &llsp->good);
+        stabilize(&llsp->sort, &llsp->good, llsp->params.contribution);
         trisolve(llsp->good);
+        count_drops(llsp);
 
         /* collect coefficients */
         size_t result_row = llsp->good.columns;
@@ -138,21 +132,182 @@ double llsp_predict(llsp_t *restrict llsp, const double *restrict metrics)
 
 void llsp_dispose(llsp_t *restrict llsp)
 {
-    const size_t index_last = llsp->good.columns - 1;
+    const size_t index_last = llsp->full.columns - 1;  // the extra column allocated for the dropping scan
 
-    free(llsp->good.matrix[index_last]);
+    if (llsp->good.matrix) free(llsp->good.matrix[index_last]);
     free(llsp->full.matrix);
     free(llsp->sort.matrix);
     free(llsp->good.matrix);
     free(llsp->data);
+    free(llsp->drops);
     free(llsp);
 }
 
+struct llsp_drops llsp_drop_stats(const llsp_t *restrict llsp, size_t metric)
+{
+    struct llsp_drops none = { llsp->solves, 0, 0 };
+    if (!llsp->drops || metric >= llsp->metrics) return none;
+    return llsp->drops[metric];
+}
+
+#pragma mark -
+
+
+#pragma mark Persistence
+
+/* Layout of a saved state, all fields are 64 bit wide:
+ *     metrics count, has data flag, last measured value, coefficients[metrics]
+ * and if there is data:
+ *     column order of the sort matrix[columns], data block[columns * rows] */
+struct llsp_state {
+    uint64_t metrics;
+    uint64_t has_data;
+    double   last_measured;
+    double   payload[];
+};
+
+size_t llsp_state_size(const llsp_t *restrict llsp)
+{
+    const size_t column_count = llsp->full.columns;
+    const size_t row_count = llsp->full.columns + 1;
+
+    size_t size = sizeof(struct llsp_state) + llsp->metrics * sizeof(double);
+    if (llsp->data)
+        size += column_count * sizeof(uint64_t) + column_count * row_count * sizeof(double);
+    return size;
+}
+
+void llsp_save(const llsp_t *restrict llsp, void *restrict buffer)
+{
+    const size_t column_count = llsp->full.columns;
+    const size_t row_count = llsp->full.columns + 1;
+    struct llsp_state *state = buffer;
+
+    state->metrics = llsp->metrics;
+    state->has_data = (llsp->data != NULL);
+    state->last_measured = llsp->last_measured;
+    memcpy(state->payload, llsp->result, llsp->metrics * sizeof(double));
+
+    if (!llsp->data) return;
+
+    /* the sort matrix only holds pointers into the data block, save them as column indices */
+    uint64_t *order = (uint64_t *)(state->payload + llsp->metrics);
+    for (size_t column = 0; column < column_count; column++)
+        order[column] = (uint64_t)(llsp->sort.matrix[column] - llsp->data) / row_count;
+
+    memcpy(order + column_count, llsp->data, column_count * row_count * sizeof(double));
+}
+
+bool llsp_load(llsp_t *restrict llsp, const void *restrict buffer, size_t size)
+{
+    const size_t column_count = llsp->full.columns;
+    const size_t row_count = llsp->full.columns + 1;
+    const struct llsp_state *state = buffer;
+
+    if (size < sizeof(struct llsp_state) || state->metrics != llsp->metrics)
+        return false;
+    if (size != sizeof(struct llsp_state) + llsp->metrics * sizeof(double) +
+                (state->has_data ? column_count * (sizeof(uint64_t) + row_count * sizeof(double)) : 0))
+        return false;
+
+    const uint64_t *order = (const uint64_t *)(state->payload + llsp->metrics);
+    if (state->has_data) {
+        /* the column order must be a permutation */
+        bool seen[column_count];
+        memset(seen, 0, sizeof(seen));
+        for (size_t column = 0; column < column_count; column++) {
+            if (order[column] >= column_count || seen[order[column]]) return false;
+            seen[order[column]] = true;
+        }
+    }
+
+    llsp->last_measured = state->last_measured;
+    memcpy(llsp->result, state->payload, llsp->metrics * sizeof(double));
+
+    if (state->has_data) {
+        if (!llsp->data) allocate(llsp);
+        for (size_t column = 0; column < column_count; column++)
+            llsp->sort.matrix[column] = llsp->data + order[column] * row_count;
+        memcpy(llsp->data, order + column_count, column_count * row_count * sizeof(double));
+    }
+
+    return true;
+}
+
+void llsp_merge(llsp_t *restrict llsp, const llsp_t *restrict other)
+{
+    if (other->metrics != llsp->metrics || !other->data) return;
+    if (!llsp->data) allocate(llsp);
+
+    /* The rows of the other triangular matrix are orthogonal combinations of
+     * all tuples it has seen, so adding them as tuples yields the same normal
+     * equations as adding the original tuples. */
+    double metrics[other->metrics];
+    for (size_t row = 0; row < other->full.columns; row++) {
+        bool empty = true;
+        for (size_t column = 0; column < other->metrics; column++) {
+            metrics[column] = other->full.matrix[column][row];
+            if (metrics[column] != 0.0) empty = false;
+        }
+        double target = other->full.matrix[other->metrics][row];
+        if (empty && target == 0.0) continue;
+
+        insert_row(llsp, metrics, target);
+    }
+}
+
 #pragma mark -
 
 
 #pragma mark Helper Functions
 
+static void allocate(llsp_t *llsp)
+{
+    const size_t column_count = llsp->full.columns;
+    const size_t row_count = llsp->full.columns + 1;  // extra row for shifting down and trisolve
+    const size_t column_size = row_count * sizeof(double);
+    const size_t data_size = column_count * row_count * sizeof(double);
+    const size_t matrix_size = column_count * sizeof(double *);
+    const size_t index_last = column_count - 1;
+
+    llsp->data        = malloc(data_size);
+    llsp->full.matrix = malloc(matrix_size);
+    llsp->sort.matrix = malloc(matrix_size);
+    llsp->good.matrix = malloc(matrix_size);
+    if (!llsp->data || !llsp->full.matrix || !llsp->sort.matrix || !llsp->good.matrix)
+        abort();
+
+    for (size_t column = 0; column < llsp->full.columns; column++)
+        llsp->full.matrix[column] =
+        llsp->sort.matrix[column] = llsp->data + column * row_count;
+
+    llsp->drops = calloc(llsp->metrics, sizeof(struct llsp_drops));
+    if (!llsp->drops) abort();
+
+    /* we need an extra column for the column dropping scan */
+    llsp->good.matrix[index_last] = malloc(column_size);
+    if (!llsp->good.matrix[index_last]) abort();
+
+    memset(llsp->data, 0, data_size);
+}
+
+static void insert_row(llsp_t *restrict llsp, const double *restrict metrics, double target)
+{
+    const size_t column_count = llsp->full.columns;
+    const size_t row_count = llsp->full.columns + 1;
+    const size_t data_size = column_count * row_count * sizeof(double);
+
+    /* add new row to the top of the solving matrix */
+    memmove(llsp->data + 1, llsp->data, data_size - sizeof(double));
+    for (size_t column = 0; column < llsp->metrics; column++)
+        llsp->full.matrix[column][0] = metrics[column];
+    llsp->full.matrix[llsp->metrics][0] = target;
+
+    /* givens fixup of the subdiagonal */
+    for (size_t i = 0; i < llsp->sort.columns; i++)
+        givens_fixup(llsp->sort, i + 1, i);
+}
+
 static void givens_fixup(struct matrix m, size_t row, size_t column)
 {
     if (fabs(m.matrix[column][row]) < EPSILON) {  // alread zero
@@ -188,7 +343,7 @@ static void givens_fixup(struct matrix m, size_t row, size_t column)
     }
 }
 
-static void stabilize(struct matrix *sort, struct matrix *good)
+static void stabilize(struct matrix *sort, struct matrix *good, double contribution)
 {
     const size_t column_count = sort->columns;
     const size_t row_count = sort->columns + 1;  // extra row for shifting down and trisolve
@@ -211,7 +366,7 @@ static void stabilize(struct matrix *sort, struct matrix *good)
 
         double residual = fabs(good->matrix[column][column]);
         if (residual >= EPSILON && previous_residual >= EPSILON)
-            drop[column] = (residual / previous_residual < COLUMN_CONTRIBUTION);
+            drop[column] = (residual / previous_residual < contribution);
         else if (residual >= EPSILON && previous_residual < EPSILON)
             drop[column] = false;
         else
@@ -263,6 +418,28 @@ static void stabilize(struct matrix *sort, struct matrix *good)
     }
 }
 
+static void count_drops(llsp_t *llsp)
+{
+    const size_t row_count = llsp->full.columns + 1;
+    const size_t index_last = llsp->good.columns - 1;
+
+    llsp->solves++;
+    for (size_t metric = 0; metric < llsp->metrics; metric++) {
+        llsp->drops[metric].solves = llsp->solves;
+        llsp->drops[metric].streak++;  // reset below for every kept column
+    }
+
+    /* kept columns point into the data block, dropped ones share the extra last column */
+    for (size_t column = 0; column < index_last; column++) {
+        size_t metric = (size_t)(llsp->sort.matrix[column] - llsp->data) / row_count;
+        if (metric >= llsp->metrics) continue;
+        if (llsp->good.matrix[column] == llsp->good.matrix[index_last])
+            llsp->drops[metric].dropped++;
+        else
+            llsp->drops[metric].streak = 0;
+    }
+}
+
 static void trisolve(struct matrix m)
 {
     size_t result_row = m.columns;  // use extra row to solve the coefficients
@@ -4,6 +4,7 @@
  */
 
 #include <stddef.h>
+#include <stdbool.h>
 
 /* An online updating solver for Linear Least Squares Problems.
  * Uses automatic stabilization by dropping columns to prevent overfitting.
@@ -19,6 +20,11 @@
  *     prediction = llsp_predict(solver, metrics);
  * tear down:
  *     llsp_dispose(solver);
+ * persist the solver state, e.g. to continue in a later run:
+ *     buffer = malloc(llsp_state_size(solver));
+ *     llsp_save(solver, buffer);
+ *     ...
+ *     llsp_load(solver, buffer, size);
  */
 
 /* The running solution can be made to age out previously acquired knowledge
@@ -44,9 +50,22 @@
 /* an opaque handle for the LLSP solver/predictor */
 typedef struct llsp_s llsp_t;
 
+/* The tuning parameters of a solver, the macros above are their defaults. */
+struct llsp_params {
+    double aging;           // see AGING_FACTOR
+    double contribution;    // see COLUMN_CONTRIBUTION
+};
+
+/* Returns the parameters llsp_new() uses. */
+struct llsp_params llsp_default_params(void);
+
 /* Allocates a new LLSP handle with the given number of metrics. */
 llsp_t *llsp_new(size_t count);
 
+/* Like llsp_new(), but with the given parameters instead of the defaults.
+ * Passing NULL is the same as calling llsp_new(). */
+llsp_t *llsp_new_ex(size_t count, const struct llsp_params *params);
+
 /* This function adds another tuple of (metrics, measured target value) to the
  * LLSP solution. The metrics array must have as many values as stated in count
  * passed to llsp_new(). */
@@ -61,5 +80,36 @@ const double *llsp_solve(llsp_t *restrict llsp);
  * populated with a set of prediction coefficients by running llsp_solve(). */
 double llsp_predict(llsp_t *restrict llsp, const double *restrict metrics);
 
+/* Column dropping statistics of one metric: in how many of the solves so far
+ * its column was dropped, and for how many of the most recent ones in a row.
+ * A metric that is dropped all the time does not contribute to predictions. */
+struct llsp_drops {
+    size_t solves;
+    size_t dropped;
+    size_t streak;
+};
+
+/* Returns the column dropping statistics of the metric with the given index. */
+struct llsp_drops llsp_drop_stats(const llsp_t *restrict llsp, size_t metric);
+
 /* Frees the LLSP context. */
 void llsp_dispose(llsp_t *restrict llsp);
+
+/* Returns the number of bytes llsp_save() needs for the state of this context. */
+size_t llsp_state_size(const llsp_t *restrict llsp);
+
+/* Serializes the accumulated knowledge and the current coefficients into the
+ * buffer, which must be at least llsp_state_size() bytes large. The format is
+ * flat and position-independent, so it can be written to disk as is. */
+void llsp_save(const llsp_t *restrict llsp, void *restrict buffer);
+
+/* Replaces the state of the context with one written by llsp_save(). Returns
+ * false and leaves the context untouched if the buffer was not produced by a
+ * context with the same number of metrics. */
+bool llsp_load(llsp_t *restrict llsp, const void *restrict buffer, size_t size);
+
+/* Adds the knowledge accumulated in another context with the same number of
+ * metrics, as if all of its metrics/target tuples had been added to this one
+ * as well. No aging is applied for the merge. llsp_solve() has to be run
+ * afterwards to update the coefficients. */
+void llsp_merge(llsp_t *restrict llsp, const llsp_t *restrict other);
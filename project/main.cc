@@ -35,8 +35,8 @@ int main(int argc, char *argv[]) {
     auto energy_reading_end = energy->read();
 
     std::cout << "Performance results: " << std::endl;
-    for (auto &[name, val]: perf_reading_end) {
-        std::cout << " " << name << " -> " << val - perf_reading_start[name] << std::endl;
+    for (size_t i = 0; i < perf::COUNTERS; i++) {
+        std::cout << " " << perf::CounterNames[i] << " -> " << perf_reading_end[i] - perf_reading_start[i] << std::endl;
     }
 
     std::cout << "Energy result: " << energy_reading_end - energy_reading_start << " uJ" << std::endl;*/
@@ -0,0 +1,195 @@
+#include "model_store.h"
+#include "debug_util.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>   // flock
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace model_store {
+
+    static const char MAGIC[8] = {'G', 'B', 'X', 'M', 'O', 'D', 'E', 'L'};
+    /* Bump whenever the layout of the file or of a payload changes, older files are then ignored */
+    static const uint32_t VERSION = 1;
+    static const size_t KEY_SIZE = 96;
+
+    struct file_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+    };
+
+    struct entry_header {
+        char key[KEY_SIZE];
+        uint32_t kind;
+        uint32_t metrics;
+        uint64_t generation;
+        uint64_t size;          // payload size, the payload is padded to 8 bytes
+    };
+
+    static size_t padded(size_t size) {
+        return (size + 7) & ~size_t(7);
+    }
+
+    Store::Store(const std::string &path) : _path{path} {
+        _entries = read(path);
+        for (auto &[key, entry]: _entries)
+            _loaded[key] = entry.generation;
+
+        LOGGER->info("Loaded %lu models from %s\n", _entries.size(), path.c_str());
+    }
+
+    std::map<std::string, Entry, std::less<>> Store::read(const std::string &path) {
+        std::map<std::string, Entry, std::less<>> entries;
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            return entries;     // no store yet
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(file_header)) {
+            close(fd);
+            return entries;
+        }
+
+        size_t size = st.st_size;
+        void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            LOGGER->warning("Failed to map model store %s\n", path.c_str());
+            return entries;
+        }
+
+        auto base = static_cast<const char *>(map);
+        auto header = reinterpret_cast<const file_header *>(base);
+        if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION) {
+            LOGGER->warning("Ignoring model store %s with unknown format or version\n", path.c_str());
+            munmap(map, size);
+            return entries;
+        }
+
+        size_t offset = sizeof(file_header);
+        for (uint32_t i = 0; i < header->count; i++) {
+            if (offset + sizeof(entry_header) > size)
+                break;
+            auto eh = reinterpret_cast<const entry_header *>(base + offset);
+            offset += sizeof(entry_header);
+            if (offset + eh->size > size)
+                break;
+
+            Entry entry;
+            entry.kind = eh->kind;
+            entry.metrics = eh->metrics;
+            entry.generation = eh->generation;
+            entry.payload.assign(base + offset, base + offset + eh->size);
+            entries[std::string(eh->key, strnlen(eh->key, KEY_SIZE))] = std::move(entry);
+
+            offset += padded(eh->size);
+        }
+
+        munmap(map, size);
+        return entries;
+    }
+
+    const Entry *Store::find(std::string_view key, uint32_t kind, uint32_t metrics) const {
+        auto it = _entries.find(key);
+        if (it == _entries.end() || it->second.kind != kind || it->second.metrics != metrics)
+            return nullptr;
+        return &it->second;
+    }
+
+    void Store::put(const std::string &key, Entry entry) {
+        if (key.size() >= KEY_SIZE) {
+            LOGGER->warning("Region key %s is too long for the model store\n", key.c_str());
+            return;
+        }
+        _entries[key] = std::move(entry);
+    }
+
+    bool Store::write(const Merge &merge) {
+        /* Serialize concurrent writers, the lock file stays in place while the store itself is replaced */
+        int lock_fd = open((_path + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+        if (lock_fd != -1)
+            flock(lock_fd, LOCK_EX);
+
+        auto on_disk = read(_path);
+        for (auto &[key, theirs]: on_disk) {
+            auto ours = _entries.find(key);
+            if (ours == _entries.end()) {
+                _entries[key] = theirs;     // a region that did not run this time
+                continue;
+            }
+
+            Entry &entry = ours->second;
+            auto loaded = _loaded.find(key);
+            bool shared_base = loaded != _loaded.end();
+            bool changed = !shared_base || loaded->second != theirs.generation;
+            if (changed && entry.kind == theirs.kind && entry.metrics == theirs.metrics) {
+                if (!shared_base) {
+                    merge(key, entry, theirs);     // independent histories
+                } else if (!entry.changes.empty()) {
+                    uint64_t generation = entry.generation;
+                    entry.payload = std::move(entry.changes);   // theirs plus what this process added since the load
+                    merge(key, entry, theirs);
+                    entry.generation = generation;
+                }   // else the newest wins, which is ours
+            }
+            entry.changes.clear();
+            entry.generation = std::max(entry.generation, theirs.generation);
+        }
+
+        std::string tmp_path = _path + ".tmp." + std::to_string(getpid());
+        FILE *file = fopen(tmp_path.c_str(), "wb");
+        bool ok = file != nullptr;
+        if (ok) {
+            file_header header;
+            memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.count = _entries.size();
+            ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+            static const char padding[8] = {0};
+            for (auto &[key, entry]: _entries) {
+                if (!ok) break;
+
+                entry.generation++;
+
+                entry_header eh;
+                memset(&eh, 0, sizeof(eh));
+                strncpy(eh.key, key.c_str(), KEY_SIZE - 1);
+                eh.kind = entry.kind;
+                eh.metrics = entry.metrics;
+                eh.generation = entry.generation;
+                eh.size = entry.payload.size();
+
+                ok = fwrite(&eh, sizeof(eh), 1, file) == 1 &&
+                     fwrite(entry.payload.data(), 1, entry.payload.size(), file) == entry.payload.size() &&
+                     fwrite(padding, 1, padded(eh.size) - eh.size, file) == padded(eh.size) - eh.size;
+
+                _loaded[key] = entry.generation;
+            }
+            ok = (fclose(file) == 0) && ok;
+        }
+
+        if (ok)
+            ok = rename(tmp_path.c_str(), _path.c_str()) == 0;
+        if (!ok) {
+            LOGGER->error("Failed to write model store %s\n", _path.c_str());
+            unlink(tmp_path.c_str());
+        } else {
+            LOGGER->info("Wrote %lu models to %s\n", _entries.size(), _path.c_str());
+        }
+
+        if (lock_fd != -1) {
+            flock(lock_fd, LOCK_UN);
+            close(lock_fd);
+        }
+
+        return ok;
+    }
+
+} /* namespace model_store */
@@ -0,0 +1,73 @@
+#ifndef __MODEL_STORE_H__
+#define __MODEL_STORE_H__
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace model_store {
+
+    enum Kind : uint32_t {
+        LLSP   = 1,     // one serialized llsp solver per event
+        WINDOW = 2      // training window of a python predictor
+    };
+
+/* \brief The persisted model state of one region */
+    struct Entry {
+        uint32_t kind = 0;
+        uint32_t metrics = 0;       // number of metrics the state was trained with
+        uint64_t generation = 0;    // incremented on every write, used to detect concurrent writers
+        std::vector<char> payload;  // opaque to the store
+        // what this process added since the entry was loaded, in the format of the payload, empty if it does not keep it;
+        // not written to the file
+        std::vector<char> changes;
+    };
+
+/* \brief An on-disk store of per-region models, keyed by elf_util::stable_key
+ *
+ * The file is a flat sequence of fixed-size headers and payloads, so it is read
+ * by mapping it into memory. It is loaded once and written back as a whole:
+ * entries of regions that did not run are carried over, and entries that were
+ * changed by another process since they were loaded are handed to a merge
+ * callback instead of being overwritten.
+ *
+ * Both processes then started from the same loaded entry, so merging the full
+ * states would count that shared base twice. The merge therefore gets only the
+ * changes of this process and folds them into the other process's entry; if
+ * an entry has no changes kept, the newest one (this process's) wins. Entries
+ * that were not loaded have no shared base and are merged as they are. */
+    class Store {
+    public:
+        /* Folds ours into theirs and leaves the result in ours. */
+        using Merge = std::function<void(const std::string &key, Entry &ours, const Entry &theirs)>;
+
+    private:
+        std::string _path;
+        std::map<std::string, Entry, std::less<>> _entries;     // looked up by string_view
+        // generation of each entry as it was loaded, to tell which ones changed on disk in between
+        std::map<std::string, uint64_t> _loaded;
+
+        static std::map<std::string, Entry, std::less<>> read(const std::string &path);
+
+    public:
+        explicit Store(const std::string &path);
+
+        const std::string &path() const { return _path; }
+
+        /* Returns the entry for the key if it has the given kind and metrics count. */
+        const Entry *find(std::string_view key, uint32_t kind, uint32_t metrics) const;
+
+        void put(const std::string &key, Entry entry);
+
+        /* Writes all entries, merging with what other processes wrote to the file in the meantime. */
+        bool write(const Merge &merge);
+    };
+
+} /* namespace model_store */
+
+#endif /* __MODEL_STORE_H__ */
@@ -10,17 +10,48 @@
 #include <cstdint>      // uintptr_t
 #include <iostream>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <array>
+#include <cmath>        // fabs
+#include <cstring>      // memcpy
+#include <chrono>       // steady_clock
 #include <pthread.h>
+#include <csignal>      // SIGUSR1
 
 #include "perf.h"
 #include "energy.h"
 #include "debug_util.h"
 #include "predictor_py.h"
+#include "elf_util.h"
+#include "model_store.h"
+#include "daemon_client.h"
+#include "daemon_protocol.h"
+#include "omp_features.h"
+#include "governor.h"
+#include "dvfs.h"
+#include "schedule_tuner.h"
+#include "placement.h"
+#include "graybox_table.h"
+#include "histogram.h"
+#include "overhead.h"
+#include "arena.h"
 
 #include "MyAllocator.h"
+#include "feature_map.h"
 
 #define ARRAY_SIZE 8192
-#define NR_METRICS 10       // 9 for array sizes + 1 for number of threads
+#define FEATURE_WIDTH 9     // default number of array sizes per function, the number of threads comes on top
+#define DISCOVERY_SCANS 3   // number of first calls of a function in which its data is searched for arrays
+#define PRUNE_AFTER 50      // default number of solves in a row a feature has to be dropped by llsp to be pruned
+#define GOVERNOR_MIN_SAMPLES 3  // samples a function needs before the governor trusts its model
+#define NR_EVENTS 6
+#define GLOBAL_METRICS 5    // bias, threads, total bytes, loop trip count, function size
+#define STATIC_MIN_BYTES 64 // smaller static objects are scalars, their size says nothing about the work
+#define SCALAR_WIDTH 4      // default number of integer fields of the data block per function whose values are metrics
+#define SCALAR_BYTES 64     // start of the data block whose integer fields are candidates
+#define SCALAR_LEARN 8      // first calls of a function over which its fields are chosen
+#define SCALAR_MIN_CORRELATION 0.5  // absolute correlation with one of the events a field needs to be chosen
 
 extern "C" {
 
@@ -28,6 +59,15 @@ typedef struct llsp_s llsp_t;
 
 llsp_t *llsp_new(size_t count);
 
+struct llsp_params {
+    double aging;
+    double contribution;
+};
+
+struct llsp_params llsp_default_params(void);
+
+llsp_t *llsp_new_ex(size_t count, const struct llsp_params *params);
+
 void llsp_add(llsp_t *llsp, const double *metrics, double target);
 
 const double *llsp_solve(llsp_t *llsp);
@@ -35,12 +75,34 @@ const double *llsp_solve(llsp_t *llsp);
 double llsp_predict(llsp_t *llsp, const double *metrics);
 
 void llsp_dispose(llsp_t *llsp);
+
+size_t llsp_state_size(const llsp_t *llsp);
+
+void llsp_save(const llsp_t *llsp, void *buffer);
+
+bool llsp_load(llsp_t *llsp, const void *buffer, size_t size);
+
+void llsp_merge(llsp_t *llsp, const llsp_t *other);
+
+struct llsp_drops {
+    size_t solves;
+    size_t dropped;
+    size_t streak;
+};
+
+struct llsp_drops llsp_drop_stats(const llsp_t *llsp, size_t metric);
 }
 
+extern "C" int omp_get_level(void);    // omp.h is not included to keep our own declarations of the omp functions
+extern "C" int omp_get_thread_num(void);
+
 enum Event {
     INSTRUCTIONS = 0,
     CACHE_MISSES = 1,
-    ENERGY       = 2
+    ENERGY       = 2,
+    DURATION     = 3,   // wall-clock time of the region in seconds, from the monotonic clock
+    CYCLES       = 4,
+    REF_CYCLES   = 5
 };
 
 enum Predictor {
@@ -49,76 +111,286 @@ enum Predictor {
     GPR  = 2,
     NN   = 3,
     SVM  = 4,
+    DAEMON = 5,
 };
 
-std::map<uint64_t, std::string> EventNames = {{Event::INSTRUCTIONS, "Instructions"},
-                                              {Event::CACHE_MISSES, "Cache-Misses"},
-                                              {Event::ENERGY,       "Energy"}};
+std::map<uint64_t, std::string> EventNames __attribute__ ((init_priority(101))) = {{Event::INSTRUCTIONS, "Instructions"},
+                                                                                  {Event::CACHE_MISSES, "Cache-Misses"},
+                                                                                  {Event::ENERGY,       "Energy"},
+                                                                                  {Event::DURATION,     "Duration"},
+                                                                                  {Event::CYCLES,       "Cycles"},
+                                                                                  {Event::REF_CYCLES,   "Ref-Cycles"}};
+// order of the events in the solvers and in the columns of the csv files
+const Event EventOrder[NR_EVENTS] = {Event::CACHE_MISSES, Event::ENERGY, Event::INSTRUCTIONS, Event::DURATION, Event::CYCLES,
+                                     Event::REF_CYCLES};
+
+int event_index(Event event) {  // position of the event in EventOrder
+    for (int i = 0; i < NR_EVENTS; i++)
+        if (EventOrder[i] == event) return i;
+    return -1;
+}
+
+perf::Counter perf_counter(Event event) {   // position of the event in perf::Values, COUNTERS for energy and duration
+    switch (event) {
+        case Event::INSTRUCTIONS:
+            return perf::INSTRUCTIONS;
+        case Event::CACHE_MISSES:
+            return perf::CACHE_MISSES;
+        case Event::CYCLES:
+            return perf::CYCLES;
+        case Event::REF_CYCLES:
+            return perf::REF_CYCLES;
+        default:
+            return perf::COUNTERS;
+    }
+}
+
 std::map<uint64_t, std::string> PredictorNames __attribute__ ((init_priority(101))) = {{Predictor::LLSP, "llsp"},
                                                                                        {Predictor::POLY, "poly"},
                                                                                        {Predictor::GPR,  "gpr"},
                                                                                        {Predictor::NN,   "nn"},
-                                                                                       {Predictor::SVM,  "svm"},};
-
-struct llsps_s {
-    std::pair<llsp_s *, std::string> events[3] = {
-            {llsp_new(NR_METRICS), EventNames[Event::CACHE_MISSES]},
-            {llsp_new(NR_METRICS), EventNames[Event::ENERGY]},
-            {llsp_new(NR_METRICS), EventNames[Event::INSTRUCTIONS]}
-    };
+                                                                                       {Predictor::SVM,  "svm"},
+                                                                                       {Predictor::DAEMON, "daemon"},};
+
+// number of metrics of every function: number of threads + feature_width array sizes + the OpenMP runtime features + scalar_width fields
+unsigned int feature_width = FEATURE_WIDTH;
+bool runtime_features = true;
+unsigned int scalar_width = SCALAR_WIDTH;
+unsigned int scalar_start = FEATURE_WIDTH + 1 + omp_features::COUNT;    // position of the first field in the metrics
+unsigned int nr_metrics = FEATURE_WIDTH + 1 + omp_features::COUNT + SCALAR_WIDTH;
+unsigned int prune_after = PRUNE_AFTER;
+
+// aging and column contribution of the solvers, LLSP_AGING and LLSP_CONTRIBUTION for all, LLSP_PARAMS per function
+llsp_params llsp_defaults;     // set in setup, the constructors of this file may run after it
+InternalMap<InternalString, llsp_params, std::less<>> llsp_overrides __attribute__ ((init_priority(101)));    // key = function id or stable key
+
+struct llsps_s : InternalObject {
+    size_t metrics;
+    std::pair<llsp_s *, std::string> events[NR_EVENTS];
+
+    explicit llsps_s(size_t metrics = nr_metrics, llsp_params params = llsp_defaults) : metrics{metrics} {     // one solver per event, in EventOrder
+        for (int i = 0; i < NR_EVENTS; i++)
+            events[i] = {llsp_new_ex(metrics, &params), EventNames[EventOrder[i]]};
+    }
 };
 
 const char *current_predictor;
 
-struct python_predictors {
-    std::pair<python::Predictor *, std::string> events[3] = {
-            {new python::Predictor(current_predictor, NR_METRICS), EventNames[Event::CACHE_MISSES]},
-            {new python::Predictor(current_predictor, NR_METRICS), EventNames[Event::ENERGY]},
-            {new python::Predictor(current_predictor, NR_METRICS), EventNames[Event::INSTRUCTIONS]}
-    };
-};
-
 std::mutex map_lock;
-std::mutex perf_lock;
 std::mutex thread_num_lock;
 std::mutex accessible_and_count_lock;
 
 int thread_num;
 
 // map for saving mallocs after this constructor ran -> key = address, value = size
-std::map<long long, size_t, std::less<long long>, MyAllocator<std::pair<const long long, size_t >>> malloc_map __attribute__ ((init_priority(101)));
+InternalMap<long long, size_t> malloc_map __attribute__ ((init_priority(101)));
 
 // array for saving mallocs before map is initialized
 std::pair<void *, size_t> malloc_info[ARRAY_SIZE];
 
-// if having found addresses, save the position at which they have to be hand over to the predictor
-std::map<long long, std::pair<int, size_t>> found_addresses_map;
+// arrays in .data and .bss of the program, e.g. Fortran common blocks, built by setup unless STATIC_DATA=0
+elf_util::StaticData static_data __attribute__ ((init_priority(101)));
+
+size_t array_bytes(long long word) {    // size of the array a word of a data block points to, 0 if it points to none, map_lock has to be held
+    auto it = malloc_map.find(word);
+    if (it != malloc_map.end()) return it->second;      // malloc has seen this address
+    return static_data.bytes_from(word);    // the rest of a static object it points into
+}
+
+// an integer field of the data block whose value is a metric, e.g. a loop bound the compiler passes by value
+struct ScalarField {
+    long offset;            // in bytes from the start of the data block
+    int width;              // 4 or 8 bytes
+    double correlation;     // strongest absolute correlation with one of the events over the calls it was chosen from
+};
+
+// the value of each candidate field, or -1 if it did not look like an integer, and the measurements of one call
+struct ScalarSample {
+    std::array<int64_t, SCALAR_BYTES / 4 + SCALAR_BYTES / 8> values;
+    std::array<double, NR_EVENTS> results;
+};
+
+// which integer fields of the data block of a function are metrics, chosen once from its first SCALAR_LEARN calls
+struct ScalarMap {
+    InternalVector<ScalarField> fields;     // one per slot
+    InternalVector<ScalarSample> samples;   // of the calls so far, dropped once the fields are chosen
+    bool chosen = false;
+};
 
-// solvers for prediction
-std::map<void (*)(void *), llsps_s> llsp_solvers __attribute__ ((init_priority(101)));
-std::map<void (*)(void *), python_predictors> python_solvers __attribute__ ((init_priority(101)));
+// connection to graybox-daemon, only if PREDICTOR=daemon
+std::unique_ptr<daemon_client::Client> daemon_conn __attribute__ ((init_priority(101)));
+std::mutex daemon_lock;     // one connection for the calls of all threads
+
+// model across all functions on features that do not depend on the function, predicts for functions that have too few samples of their own
+std::unique_ptr<llsps_s> global_solvers __attribute__ ((init_priority(101)));
+std::unique_ptr<llsps_s> global_changes __attribute__ ((init_priority(101)));     // only the samples of this run, with MODEL_STORE
+std::mutex global_lock;     // every function feeds it
+// number of samples after which a function's own model fully takes over from the global one, 0 disables the global model
+unsigned int global_blend;
+
+// how far off the predictions of a function were so far
+struct PredictionError {
+    uint64_t samples = 0;
+    double absolute = 0.0;          // sums over all samples
+    double relative = 0.0;
+    uint64_t relative_samples = 0;  // samples with a measurement other than 0
+    double max_relative = 0.0;
+};
+
+// distribution of each event and of its relative prediction error per function, for the tail percentiles
+struct RegionHistograms {
+    histogram::Histogram values[NR_EVENTS];
+    histogram::Histogram errors[NR_EVENTS];
+};
+std::atomic<bool> histogram_dump_requested{false};     // set by SIGUSR1, the monitoring thread writes the dump
+
+// own work of my_omp.so on the calling thread from the start to the end of each call, against the time the function ran
+struct RegionOverhead {
+    overhead::Ticks ticks{};    // sums over all calls
+    double region_time = 0.0;
+    uint64_t calls = 0;
+};
+
+// each event summed over all calls, inclusive and without the calls that ran inside them (exclusive)
+struct RegionAttribution {
+    double inclusive[NR_EVENTS] = {};
+    double exclusive[NR_EVENTS] = {};
+    uint64_t calls = 0;
+    uint64_t nested_calls = 0;      // calls that ran inside another call
+    uint64_t overlapped_calls = 0;  // calls that ran while an outermost call of another application thread ran, not fed
+};
+
+// everything kept per function (= parallel region), created once by register_function and never moved or freed
+struct Region : InternalObject {
+    void (*fn)(void *);
+    uint64_t id;                    // 1, 2, 3,... in the order the functions were seen first
+    InternalString key;             // identity that stays the same across runs, used as key in the model store
+    size_t size = 0;                // static size of the outlined function, 0 if unknown
+    int64_t daemon = -1;            // region of the daemon, -1 if the daemon does not predict the function
+
+    std::mutex lock;                // the members below, calls of a function may start and end on several threads at once
+    std::unique_ptr<llsps_s> llsp;  // with llsp, also created on first use after the daemon was lost
+    std::unique_ptr<llsps_s> changes;   // only the samples of this run, with MODEL_STORE, see model_store::Entry::changes
+    python::Predictor *python = nullptr;
+    uint64_t samples = 0;
+    FeatureMap features;
+    ScalarMap scalars;
+    std::array<PredictionError, NR_EVENTS> errors{};
+    RegionOverhead overhead;
+    RegionAttribution attribution;
+    std::ofstream measurements;     // written under output_lock, together with progress.csv
+    std::ofstream predictions;
+
+    RegionHistograms histograms;    // recorded without the lock
+};
+InternalMap<void (*)(void *), std::unique_ptr<Region>> regions __attribute__ ((init_priority(101)));
+std::shared_mutex regions_lock;     // lookups share it, registering a function takes it alone
+
+// a call that started and did not end yet, it lives in the frame of the hook that runs it
+struct RegionContext {
+    Region *region = nullptr;
+    RegionContext *parent = nullptr;    // call this one runs in, on this or on another thread, nullptr for outermost calls
+    double *metrics = nullptr;          // as predicted with, for progress.csv
+    double predicted[NR_EVENTS] = {};
+    perf::Values counters{};            // at the start, a fixed array so that the boundaries do not allocate
+    uint64_t energy = 0;                // at the start
+    std::chrono::steady_clock::time_point start;
+    overhead::Ticks overhead_start{};   // ticks of the calling thread at the start
+    std::atomic<double> nested[NR_EVENTS]{};    // inclusive values of the calls that ran inside this one, from all threads of its team
+    const schedule_tuner::Config *schedule = nullptr;   // for its schedule(runtime) loops, nullptr if the call is not tuned
+    std::atomic<bool> runtime_schedule_seen{false};     // whether its team started a schedule(runtime) loop
+    std::atomic<long> runtime_trip_count{0};            // trip count of that loop
+    bool placed = false;                                // whether the placement controller chose the policy of its team
+    placement::Policy placement = placement::FREE;
+    bool overlapped = false;            // another outermost call was running when this one started
+    uint64_t overlaps_at_start = 0;     // overlap_count before the start
+};
 
-// save each function that we learn
-std::map<void (*)(void *), uint64_t> funcmap;
+// the counters count the whole process, so outermost calls of several application threads that run at the same time
+// count each other; such calls are measured, but not fed to the models, the tuner, the placement or the governor
+std::atomic<int> outermost_in_flight{0};
+std::atomic<uint64_t> overlap_count{0};     // bumped by every outermost call that starts while another one runs
+
+void start_overlap_check(RegionContext &call) {     // call.parent has to be set
+    call.overlaps_at_start = overlap_count.load();
+    if (!call.parent) {
+        call.overlapped = outermost_in_flight.fetch_add(1) > 0;
+        if (call.overlapped) overlap_count.fetch_add(1);
+    } else {
+        call.overlapped = outermost_in_flight.load() > 1;     // an outermost call besides the one it runs in
+    }
+}
+
+bool overlapped(const RegionContext &call) {    // whether another outermost call ran during the call so far
+    // one that started later bumped overlap_count, or is about to; the own outermost call counts once
+    return call.overlapped || overlap_count.load() != call.overlaps_at_start || outermost_in_flight.load() > 1;
+}
+
+// innermost call the thread runs in: the calls it started itself, linked through parent, on top of the call whose team it is in
+thread_local RegionContext *current_call = nullptr;
+
+// chooses the number of threads of each function, only if GOVERNOR is set
+std::unique_ptr<governor::ThreadGovernor> thread_governor __attribute__ ((init_priority(101)));
+
+// sets the core frequency for each function, only if DVFS is set
+std::unique_ptr<dvfs::FrequencyGovernor> frequency_governor __attribute__ ((init_priority(101)));
+
+// picks the schedule of schedule(runtime) loops, only if SCHEDULE_TUNER is set, the teams find it in the RegionContext of their call
+std::unique_ptr<schedule_tuner::ScheduleTuner> tuner __attribute__ ((init_priority(101)));
+
+// pins the threads of each function compactly or spread out, only if PLACEMENT is set
+std::unique_ptr<placement::Controller> placement_controller __attribute__ ((init_priority(101)));
+
+// models of previous runs, only if MODEL_STORE is set
+std::unique_ptr<model_store::Store> store __attribute__ ((init_priority(101)));
 
 // perf stuff
 std::unique_ptr<perf::PerfManager> perfManager __attribute__ ((init_priority(101)));
 std::unique_ptr<energy::PerfMeasure> ehandle __attribute__ ((init_priority(101)));
 perf::HandlePtr phandle __attribute__ ((init_priority(101)));
-std::map<std::string, uint64_t> perf_results;
-std::map<std::string, uint64_t> thread_results __attribute__ ((init_priority(101)));
+// a counter group and energy fd of the monitoring thread's own, the region boundaries never share a read with it
+std::unique_ptr<energy::PerfMeasure> monitor_ehandle __attribute__ ((init_priority(101)));
+perf::HandlePtr monitor_phandle __attribute__ ((init_priority(101)));
 
 // files
 std::ofstream monitoring_file __attribute__ ((init_priority(101)));
 std::ofstream progress_file __attribute__ ((init_priority(101)));
-std::map<uint64_t, std::ofstream *> measurements;
-std::map<uint64_t, std::ofstream *> predictions;
+std::ofstream model_age_file __attribute__ ((init_priority(101)));
+std::ofstream regions_file __attribute__ ((init_priority(101)));
+std::ofstream governor_file __attribute__ ((init_priority(101)));
+std::ofstream dvfs_file __attribute__ ((init_priority(101)));
+std::mutex output_lock;     // the rows of the files above and of the files of each function
 
 int count = 0;
 bool accessible = false;
-bool running = true;
+std::atomic<bool> running{true};    // the monitoring thread runs until teardown clears it
+pthread_t perf_thread;
+bool perf_thread_started = false;
+
+bool python_predictor() {   // all predictors except llsp and the daemon run in the embedded interpreter
+    return current_predictor != PredictorNames[Predictor::LLSP] && current_predictor != PredictorNames[Predictor::DAEMON];
+}
+
+void daemon_lost() {    // continue with local llsp solvers, they are created on first use of each function, daemon_lock has to be held
+    LOGGER->error("Lost the connection to the predictor daemon, falling back to llsp\n");
+    daemon_conn.reset();
+    current_predictor = PredictorNames[Predictor::LLSP].c_str();
+}
+
+void getStackBounds(uintptr_t &stack_start, uintptr_t &stack_end) {     // of the calling thread, the data blocks of the functions it starts are on it
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void *address;
+        size_t size;
+        bool found = pthread_attr_getstack(&attr, &address, &size) == 0;
+        pthread_attr_destroy(&attr);
+        if (found) {
+            stack_start = reinterpret_cast<uintptr_t>(address);
+            stack_end = stack_start + size;
+            return;
+        }
+    }
 
-void getStackBounds(uintptr_t &stack_start, uintptr_t &stack_end) {
     std::ifstream maps("/proc/self/maps");
     std::string line;
 
@@ -139,10 +411,11 @@ int get_nr_data_elems(void *data) {     // look for the number of elements we ca
         return 0;
     }
 
-    uintptr_t begin;
-    uintptr_t end;
+    static thread_local uintptr_t begin = 0;
+    static thread_local uintptr_t end = 0;
 
-    getStackBounds(begin, end);
+    if (reinterpret_cast<uintptr_t> (data) < begin || reinterpret_cast<uintptr_t> (data) > end)
+        getStackBounds(begin, end);     // only read the maps again if the stack may have grown
 
     // check if data on stack (theoretically also on heap possible)
     if(!((reinterpret_cast<uintptr_t> (data) >= begin) && (reinterpret_cast<uintptr_t> (data) <= end))){
@@ -156,18 +429,19 @@ int get_nr_data_elems(void *data) {     // look for the number of elements we ca
     return num_elems;
 }
 
-std::vector<long long> found_addresses(void *data) {
-    std::vector<long long> addresses;
+void discover_features(FeatureMap &features, void *data) {    // give the arrays found in the data block of a function the free slots
     auto my_data = (long long *) data;
     int num_elems = get_nr_data_elems(data);    // check how many elements we can access until stack ends
-    for (int i = 0; i < num_elems; i++) {
-        if (malloc_map.contains(my_data[i])) {  // if malloc has seen this address
-            if(found_addresses_map.size() < (NR_METRICS - 1) && !found_addresses_map.contains(my_data[i])) found_addresses_map[my_data[i]] = std::make_pair(found_addresses_map.size(), malloc_map[my_data[i]]);
-            addresses.push_back(my_data[i]);    // save it as found address
-            if (addresses.size() == NR_METRICS - 1) break;
+    map_lock.lock();    // the slots live in the arena, growing them does not call malloc, which takes map_lock as well
+    for (int i = 0; i < num_elems && features.offsets.size() < feature_width; i++) {
+        if (array_bytes(my_data[i]) > 0 &&      // if it points to an array on the heap or in static data
+            std::find(features.offsets.begin(), features.offsets.end(), i) == features.offsets.end()) {
+            features.offsets.push_back(i);
+            features.pruned.push_back(false);
         }
     }
-    return addresses;
+    map_lock.unlock();
+    features.scans++;
 }
 
 int already_there(void *address) {      // check at which position the address is already in the map and if so return the position
@@ -179,6 +453,28 @@ int already_there(void *address) {      // check at which position the address i
     return -1;
 }
 
+const size_t SCALAR_CANDIDATES = SCALAR_BYTES / 4 + SCALAR_BYTES / 8;
+
+ScalarField scalar_candidate(size_t candidate) {    // the 32 bit fields first, then the 64 bit ones
+    if (candidate < SCALAR_BYTES / 4) return {(long) candidate * 4, 4, 0.0};
+    return {(long) (candidate - SCALAR_BYTES / 4) * 8, 8, 0.0};
+}
+
+int64_t read_field(const char *block, const ScalarField &field) {
+    if (field.width == 4) {
+        int32_t value;
+        memcpy(&value, block + field.offset, sizeof(value));
+        return value;
+    }
+    int64_t value;
+    memcpy(&value, block + field.offset, sizeof(value));
+    return value;
+}
+
+bool pointer_like(uint64_t word) {     // user-space addresses of mappings, libraries and the stack, or an array we know, map_lock has to be held
+    return (word >= (1ull << 44) && word < (1ull << 47)) || array_bytes((long long) word) > 0;
+}
+
 void start_up_perf() {
     perfManager = std::make_unique<perf::PerfManager>();
     auto tmp = perfManager->open(getpid());
@@ -189,117 +485,687 @@ void start_up_perf() {
         exit(1);
     }
     ehandle = std::make_unique<energy::PerfMeasure>();
-    for (const auto &name: {"Instructions", "Cache-Misses", "Energy"}) {
-        thread_results[name] = 0;
-    }
+
+    auto monitor = perfManager->open(getpid());     // before the program starts threads, they inherit both groups
+    if (monitor) monitor_phandle = std::move(monitor.value());
+    if (!monitor_phandle) LOGGER->warning("Failed to initialize perf monitoring, monitoring.csv only has energy\n");
+    monitor_ehandle = std::make_unique<energy::PerfMeasure>();
 }
 
-double *get_metrics(void *data) {
-    double *ret = (double *) calloc(NR_METRICS, sizeof(double));
-    std::vector<long long> address_sizes = found_addresses(data);   // look for addresses that can be found on the stack
+double *get_metrics(Region &region, void *data, unsigned int num_threads) {    // the lock of the region has to be held
+    double *ret = (double *) calloc(nr_metrics, sizeof(double));
     thread_num_lock.lock();
-    ret[0] = thread_num;    // get the number of threads that are currently used and use it as the first metric
+    ret[0] = num_threads > 0 ? num_threads : thread_num;    // get the number of threads that are currently used and use it as the first metric
     thread_num_lock.unlock();
-    for (auto address : address_sizes){
-        if(found_addresses_map.contains(address))   // if we have seen the address before (through malloc)
-            ret[found_addresses_map[address].first + 1] = (double ) found_addresses_map[address].second; // use the corresponding size as metric (always at the same position)
+
+    FeatureMap &features = region.features;
+    auto my_data = (long long *) data;
+    int num_elems = get_nr_data_elems(data);
+    map_lock.lock();    // other threads may malloc meanwhile
+    for (size_t slot = 0; slot < features.offsets.size(); slot++) {
+        if (features.pruned[slot] || features.offsets[slot] >= num_elems) continue;
+        ret[slot + 1] = (double) array_bytes(my_data[features.offsets[slot]]);     // use the size as metric (always at the same position for this function)
+    }
+    map_lock.unlock();
+
+    if (runtime_features)   // the state of the OpenMP runtime and the core follow the array sizes
+        omp_features::Provider::get().fill(num_threads, ret + 1 + feature_width);
+
+    auto block = (const char *) data;
+    for (size_t slot = 0; slot < region.scalars.fields.size(); slot++) {   // the chosen fields come last, a few reads
+        const ScalarField &field = region.scalars.fields[slot];
+        if (field.offset + field.width <= num_elems * (long) sizeof(long long))
+            ret[scalar_start + slot] = (double) read_field(block, field);
     }
     return ret;
 }
 
-void create_csvs() {    // create a measurements and predictions file with the name of the to be measured values as header
-    std::string size = std::to_string(funcmap.size() + 1);
-    if (funcmap.size() + 1 < 10) size.insert(0, "0");
-    std::ofstream *newMeasurementFile = new std::ofstream("./csvs/measurements/" + size + ".csv");
-    std::ofstream *newPredictionFile = new std::ofstream("./csvs/predictions/" + size + ".csv");
-    if (!newMeasurementFile->is_open() || !newPredictionFile->is_open()) {
+double correlation(const InternalVector<ScalarSample> &samples, size_t candidate, int event) {   // Pearson, 0 if one of them does not change
+    double n = (double) samples.size(), sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    for (const ScalarSample &sample: samples) {
+        double x = (double) sample.values[candidate], y = sample.results[event];
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        syy += y * y;
+        sxy += x * y;
+    }
+    double vx = n * sxx - sx * sx, vy = n * syy - sy * sy;
+    if (vx <= 0 || vy <= 0) return 0.0;
+    return (n * sxy - sx * sy) / std::sqrt(vx * vy);
+}
+
+void choose_scalars(Region &region) {    // the fields that changed and followed one of the events best, without overlaps, the lock of the region has to be held
+    ScalarMap &scalars = region.scalars;
+    InternalVector<ScalarField> ranked;
+    for (size_t c = 0; c < SCALAR_CANDIDATES; c++) {
+        bool integer = std::all_of(scalars.samples.begin(), scalars.samples.end(),
+                                   [c](const ScalarSample &sample) { return sample.values[c] >= 0; });
+        if (!integer) continue;
+        ScalarField field = scalar_candidate(c);
+        for (int i = 0; i < NR_EVENTS; i++)
+            field.correlation = std::max(field.correlation, std::fabs(correlation(scalars.samples, c, i)));
+        if (field.correlation >= SCALAR_MIN_CORRELATION) ranked.push_back(field);
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const ScalarField &a, const ScalarField &b) {     // a long before its lower half
+        return a.correlation != b.correlation ? a.correlation > b.correlation : a.width > b.width;
+    });
+
+    for (const ScalarField &field: ranked) {
+        if (scalars.fields.size() >= scalar_width) break;
+        bool overlaps = std::any_of(scalars.fields.begin(), scalars.fields.end(), [&](const ScalarField &other) {
+            return field.offset < other.offset + other.width && other.offset < field.offset + field.width;
+        });
+        if (overlaps) continue;
+        scalars.fields.push_back(field);
+        LOGGER->info("Scalar field at offset %ld (%d bytes) of function %lu, correlation %f\n", field.offset, field.width,
+                     region.id, field.correlation);
+    }
+    scalars.chosen = true;
+    scalars.samples.clear();
+    scalars.samples.shrink_to_fit();
+}
+
+void learn_scalars(Region &region, void *data, const double *results) {    // the integer fields of one call, until the fields are chosen, the lock of the region has to be held
+    ScalarMap &scalars = region.scalars;
+    if (scalar_width == 0 || scalars.chosen) return;
+
+    long bytes = std::min<long>(SCALAR_BYTES, get_nr_data_elems(data) * (long) sizeof(long long));
+    auto block = (const char *) data;
+    ScalarSample sample;
+    map_lock.lock();    // nothing may allocate under it
+    for (size_t c = 0; c < SCALAR_CANDIDATES; c++) {
+        ScalarField field = scalar_candidate(c);
+        int64_t value = -1;
+        if (field.offset + field.width <= bytes) {
+            uint64_t word;
+            memcpy(&word, block + field.offset / 8 * 8, sizeof(word));
+            value = read_field(block, field);
+            bool integer = field.width == 4 ? !pointer_like(word) : (uint64_t) value < (1ull << 40) && !pointer_like(value);
+            if (!integer || value < 0) value = -1;
+        }
+        sample.values[c] = value;
+    }
+    map_lock.unlock();
+    std::copy(results, results + NR_EVENTS, sample.results.begin());
+    scalars.samples.push_back(sample);
+    if (scalars.samples.size() >= SCALAR_LEARN) choose_scalars(region);
+}
+
+void prune_features(Region &region) {   // stop extracting features that none of the solvers of a function uses
+    if (prune_after == 0) return;
+
+    FeatureMap &features = region.features;
+    for (size_t slot = 0; slot < features.offsets.size(); slot++) {
+        if (features.pruned[slot]) continue;
+        bool unused = true;
+        for (auto &solver: region.llsp->events)
+            unused &= llsp_drop_stats(solver.first, slot + 1).streak >= prune_after;
+        if (unused) {
+            features.pruned[slot] = true;
+            LOGGER->info("Pruned feature %lu (offset %ld) of function %lu\n", slot, features.offsets[slot], region.id);
+        }
+    }
+}
+
+void write_features() {    // importance of each feature: the fraction of solves in which llsp kept it, averaged over the events
+    std::ofstream features_file("./csvs/features.csv");
+    if (!features_file.is_open()) {
+        std::cout << "failed to open features file" << std::endl;
+        return;
+    }
+    features_file << "Functions,Slot,Offset,Importance,Pruned" << std::endl;
+    std::shared_lock<std::shared_mutex> guard(regions_lock);
+    for (auto &[fn, region]: regions) {
+        std::lock_guard<std::mutex> region_guard(region->lock);
+        const FeatureMap &features = region->features;
+        for (size_t slot = 0; slot < features.offsets.size(); slot++) {
+            double importance = 0.0;
+            if (region->llsp) {
+                for (auto &solver: region->llsp->events) {
+                    auto drops = llsp_drop_stats(solver.first, slot + 1);
+                    if (drops.solves > 0) importance += 1.0 - (double) drops.dropped / drops.solves;
+                }
+                importance /= NR_EVENTS;
+            }
+            features_file << region->id << "," << slot << "," << features.offsets[slot] << ","
+                          << importance << "," << features.pruned[slot] << std::endl;
+        }
+    }
+}
+
+void write_scalars() {     // the integer fields chosen as metrics, with how often llsp kept them like in features.csv
+    std::ofstream scalars_file("./csvs/scalars.csv");
+    if (!scalars_file.is_open()) {
+        std::cout << "failed to open scalars file" << std::endl;
+        return;
+    }
+    scalars_file << "Functions,Slot,Offset,Width,Correlation,Importance" << std::endl;
+    std::shared_lock<std::shared_mutex> guard(regions_lock);
+    for (auto &[fn, region]: regions) {
+        std::lock_guard<std::mutex> region_guard(region->lock);
+        const InternalVector<ScalarField> &fields = region->scalars.fields;
+        for (size_t slot = 0; slot < fields.size(); slot++) {
+            double importance = 0.0;
+            if (region->llsp) {
+                for (auto &solver: region->llsp->events) {
+                    auto drops = llsp_drop_stats(solver.first, scalar_start + slot);
+                    if (drops.solves > 0) importance += 1.0 - (double) drops.dropped / drops.solves;
+                }
+                importance /= NR_EVENTS;
+            }
+            scalars_file << region->id << "," << slot << "," << fields[slot].offset << "," << fields[slot].width << ","
+                          << fields[slot].correlation << "," << importance << std::endl;
+        }
+    }
+}
+
+void create_csvs(Region &region) {    // create a measurements and predictions file with the name of the to be measured values as header
+    std::string size = std::to_string(region.id);
+    if (region.id < 10) size.insert(0, "0");
+    region.measurements.open("./csvs/measurements/" + size + ".csv");
+    region.predictions.open("./csvs/predictions/" + size + ".csv");
+    if (!region.measurements.is_open() || !region.predictions.is_open()) {
         std::cout << "failed to open a file" << std::endl;
         exit(1);
     }
-    (*newMeasurementFile) << "Cache_Misses,Energy,Instructions," << std::endl;
-    (*newPredictionFile) << "Cache_Misses,Energy,Instructions," << std::endl;
-    measurements[funcmap.size() + 1] = newMeasurementFile;
-    predictions[funcmap.size() + 1] = newPredictionFile;
+    region.measurements << "Cache_Misses,Energy,Instructions,Duration,Cycles,Ref_Cycles," << std::endl;
+    region.predictions << "Cache_Misses,Energy,Instructions,Duration,Cycles,Ref_Cycles," << std::endl;
+}
+
+model_store::Entry save_llsps(llsps_s &solvers) {  // all solvers of a function, each prefixed with its size
+    model_store::Entry entry;
+    entry.kind = model_store::LLSP;
+    entry.metrics = solvers.metrics;
+    for (auto &solver: solvers.events) {
+        uint64_t size = llsp_state_size(solver.first);
+        size_t offset = entry.payload.size();
+        entry.payload.resize(offset + sizeof(size) + size);
+        memcpy(entry.payload.data() + offset, &size, sizeof(size));
+        llsp_save(solver.first, entry.payload.data() + offset + sizeof(size));
+    }
+    return entry;
+}
+
+bool load_llsps(llsps_s &solvers, const model_store::Entry &entry) {
+    size_t offset = 0;
+    for (auto &solver: solvers.events) {
+        uint64_t size;
+        if (offset + sizeof(size) > entry.payload.size()) return false;
+        memcpy(&size, entry.payload.data() + offset, sizeof(size));
+        offset += sizeof(size);
+        if (offset + size > entry.payload.size()) return false;
+        if (!llsp_load(solver.first, entry.payload.data() + offset, size)) return false;
+        offset += size;
+    }
+    return offset == entry.payload.size();     // stores written with another set of events do not fit
+}
+
+void restore_models(Region &region) {   // warm start the solvers of a new function with the models of previous runs
+    if (!store || current_predictor == PredictorNames[Predictor::DAEMON]) return;  // the daemon keeps its own store
+
+    const InternalString &key = region.key;
+    if (region.llsp) {
+        auto entry = store->find(key, model_store::LLSP, nr_metrics);
+        if (entry && load_llsps(*region.llsp, *entry)) {
+            LOGGER->info("Restored llsp models of function %lu (%s)\n", region.id, key.c_str());
+            region.samples = global_blend;  // trained already, no need for the global model
+        }
+    } else if (region.python) {
+        auto entry = store->find(key, model_store::WINDOW, nr_metrics);
+        if (entry && region.python->restore_window(reinterpret_cast<const double *>(entry->payload.data()),
+                                                   entry->payload.size() / sizeof(double))) {
+            LOGGER->info("Restored python training window of function %lu (%s)\n", region.id, key.c_str());
+            region.samples = global_blend;
+        }
+    }
+}
+
+void restore_global_model() {
+    if (!store || !global_solvers) return;
+
+    auto entry = store->find("global", model_store::LLSP, GLOBAL_METRICS);
+    if (entry && load_llsps(*global_solvers, *entry))
+        LOGGER->info("Restored the global model\n");
+}
+
+void merge_models(const std::string &key, model_store::Entry &ours, const model_store::Entry &theirs) {  // another run updated the same function meanwhile, ours holds only what this run added
+    if (ours.kind != model_store::LLSP) return;     // python windows: the newest one wins
+
+    llsps_s mine(ours.metrics), other(ours.metrics);
+    if (!load_llsps(mine, ours) || !load_llsps(other, theirs)) return;
+    for (int i = 0; i < NR_EVENTS; i++) {
+        llsp_merge(mine.events[i].first, other.events[i].first);
+        llsp_solve(mine.events[i].first);
+    }
+    uint64_t generation = ours.generation;
+    ours = save_llsps(mine);
+    ours.generation = generation;
+
+    for (int i = 0; i < NR_EVENTS; i++) {
+        llsp_dispose(mine.events[i].first);
+        llsp_dispose(other.events[i].first);
+    }
 }
 
-void predict_and_start_perf(void (*fn)(void *), void *data) {
-    if (!funcmap.contains(fn)) {           // if we see a new function (= new loop), then save it
-        create_csvs();                     // create a measurement and prediction csvs for each new function
-        if (current_predictor == PredictorNames[Predictor::LLSP]) llsp_solvers[fn] = llsps_s(); // if LLSP should be used, create a new llsp solver for each new function
-        else python_solvers[fn] = python_predictors(); // if a python predictor should be used, create a new python solver for each new function
-        funcmap[fn] = funcmap.size() + 1;   // assign this function pointer an ID (1, 2, 3,...)
+void save_models() {    // write the models of all functions back to the store
+    if (!store) return;
+
+    std::shared_lock<std::shared_mutex> guard(regions_lock);
+    for (auto &[fn, region]: regions) {
+        if (region->daemon >= 0) continue;    // trained by the daemon
+        std::lock_guard<std::mutex> region_guard(region->lock);
+        model_store::Entry entry;
+        if (region->llsp) {
+            entry = save_llsps(*region->llsp);
+            if (region->changes) entry.changes = save_llsps(*region->changes).payload;
+        } else if (region->python) {
+            auto window = region->python->save_window();
+            entry.kind = model_store::WINDOW;
+            entry.metrics = nr_metrics;
+            entry.payload.resize(window.size() * sizeof(double));
+            memcpy(entry.payload.data(), window.data(), entry.payload.size());
+        } else {
+            continue;
+        }
+        store->put(std::string(region->key), std::move(entry));
+    }
+    if (global_solvers) {
+        std::lock_guard<std::mutex> global_guard(global_lock);
+        model_store::Entry entry = save_llsps(*global_solvers);
+        if (global_changes) entry.changes = save_llsps(*global_changes).payload;
+        store->put("global", std::move(entry));
     }
-    std::cout << "here in func: " << funcmap[fn] << std::endl;
-    progress_file << funcmap[fn];   // save which function is executed currently
 
-    double *metrics;
+    store->write(merge_models);
+}
+
+void get_global_metrics(const Region &region, const double *metrics, long trip_count, double *global) {   // features that mean the same for every function
+    global[0] = 1.0;            // llsp has no intercept of its own
+    global[1] = metrics[0];     // number of threads
+    global[2] = 0.0;            // total size of the buffers the function works on
+    for (unsigned int i = 1; i <= feature_width; i++) global[2] += metrics[i];
+    global[3] = (double) trip_count;
+    global[4] = (double) region.size;
+}
 
-    if (current_predictor == PredictorNames[Predictor::LLSP]) {     // if the LLSP should be used
-        for (auto solver: llsp_solvers[fn].events) {    // for each metric the solver for the current function should make a prediction
-            metrics = get_metrics(data);    // get workload metrics
-            double predicted = llsp_predict(solver.first, metrics);
-            (*predictions[funcmap[fn]]) << predicted << ",";    // save the predictions in a file for later evaluation
-            printf("predicted for %s: %f\n", solver.second.c_str(), predicted);
+void parse_llsp_params(const char *list) {    // LLSP_PARAMS="<id or stable key>=<aging>:<contribution>,..."
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t equals = item.find('='), colon = item.find(':', equals);
+        if (equals == std::string::npos || colon == std::string::npos) {
+            if (!item.empty()) LOGGER->warning("Ignoring malformed LLSP_PARAMS entry %s\n", item.c_str());
+            continue;
         }
-    } else {     // if a python predictor should be used
-        for (auto solver: python_solvers[fn].events) {
-            metrics = get_metrics(data);
-            double predicted = solver.first->predict(metrics, NR_METRICS);
-            (*predictions[funcmap[fn]]) << predicted << ",";
-            printf("predicted for %s: %f\n", solver.second.c_str(), predicted);
+        llsp_overrides[InternalString(item, 0, equals)] = {strtod(item.c_str() + equals + 1, nullptr),
+                                                  strtod(item.c_str() + colon + 1, nullptr)};
+    }
+}
+
+llsp_params region_params(const Region &region) {     // the stable key wins over the id, it means the same in every run
+    if (auto it = llsp_overrides.find(std::string_view(region.key)); it != llsp_overrides.end()) return it->second;
+    std::string id = std::to_string(region.id);
+    if (auto it = llsp_overrides.find(std::string_view(id)); it != llsp_overrides.end()) return it->second;
+    return llsp_defaults;
+}
+
+void create_llsps(Region &region) {     // one solver per event, and with a store the ones that learn only this run's samples
+    region.llsp = std::make_unique<llsps_s>(nr_metrics, region_params(region));
+    if (store) region.changes = std::make_unique<llsps_s>(nr_metrics, region_params(region));
+}
+
+Region &register_function(void (*fn)(void *)) {     // if we see a new function (= new loop), then save it
+    {
+        std::shared_lock<std::shared_mutex> guard(regions_lock);
+        auto it = regions.find(fn);
+        if (it != regions.end()) return *it->second;
+    }
+    std::lock_guard<std::shared_mutex> guard(regions_lock);
+    std::unique_ptr<Region> &slot = regions[fn];
+    if (slot) return *slot;     // another thread was first
+
+    auto region = std::make_unique<Region>();
+    region->fn = fn;
+    region->id = regions.size();    // assign this function pointer an ID (1, 2, 3,...)
+    region->key = InternalString(elf_util::stable_key(reinterpret_cast<void *>(fn)));
+    create_csvs(*region);              // create a measurement and prediction csvs for each new function
+    if (current_predictor == PredictorNames[Predictor::LLSP]) create_llsps(*region); // if LLSP should be used, create a new llsp solver for each new function
+    else if (python_predictor()) region->python = new python::Predictor(current_predictor, nr_metrics, NR_EVENTS); // if a python predictor should be used, create one multi-output python solver for each new function
+    if (current_predictor == PredictorNames[Predictor::DAEMON]) {   // the daemon shares the model of this function with all other runs
+        std::lock_guard<std::mutex> daemon_guard(daemon_lock);
+        if (daemon_conn) {
+            region->daemon = daemon_conn->region(region->key);
+            if (region->daemon < 0) daemon_lost();
         }
     }
+    regions_file << region->id << "," << region->key << std::endl;
+    graybox::add(fn);
+    auto symbol = elf_util::symbol_of(reinterpret_cast<void *>(fn));
+    region->size = symbol ? symbol->size : 0;
+    restore_models(*region);
+    slot = std::move(region);
+    return *slot;
+}
+
+uint64_t function_id(const void *fn) {  // for the reports of the governors, 0 if the function never ran
+    std::shared_lock<std::shared_mutex> guard(regions_lock);
+    auto it = regions.find((void (*)(void *)) fn);
+    return it != regions.end() ? it->second->id : 0;
+}
 
-    for(int i = 0; i < NR_METRICS; i++){
-        progress_file << "," << metrics[i];     // save the workload metrics that were used for post-mortem analysis
+bool daemon_predict(const Region &region, const double *metrics, double *predicted) {   // false if the daemon cannot predict the function
+    if (region.daemon < 0) return false;
+    std::lock_guard<std::mutex> guard(daemon_lock);
+    if (!daemon_conn) return false;
+    if (daemon_conn->predict(region.daemon, metrics, predicted)) return true;
+    daemon_lost();
+    return false;
+}
+
+bool daemon_feed(const Region &region, const double *metrics, const double *results) {  // false if the daemon does not learn the function
+    if (region.daemon < 0) return false;
+    std::lock_guard<std::mutex> guard(daemon_lock);
+    if (!daemon_conn) return false;
+    daemon_conn->feed(region.daemon, metrics, results);     // only queued, sent with the next prediction
+    return true;
+}
+
+llsps_s &region_llsps(Region &region) {     // the solvers of the function, after the daemon was lost they are created on first use
+    if (!region.llsp) create_llsps(region);
+    return *region.llsp;
+}
+
+void predict_events(Region &region, const double *metrics, long trip_count, double *predicted) {   // one prediction per event, in EventOrder, the lock of the region has to be held
+    if (daemon_predict(region, metrics, predicted)) {
+        // one round trip predicts all events, queued measurements travel along
+    } else if (region.python) {     // if a python predictor should be used, one call predicts all events at once
+        region.python->predict(metrics, predicted);
+    } else {    // if the LLSP should be used
+        llsps_s &solvers = region_llsps(region);
+        for (int i = 0; i < NR_EVENTS; i++)     // for each metric the solver for the current function should make a prediction
+            predicted[i] = llsp_predict(solvers.events[i].first, metrics);
+    }
+
+    // a function with few samples of its own leans on the global model, blending over to its own model as samples come in
+    // (not for the daemon, its models were possibly trained by other runs already)
+    if (global_solvers && region.samples < global_blend && region.daemon < 0) {
+        double global[GLOBAL_METRICS];
+        get_global_metrics(region, metrics, trip_count, global);
+        double weight = (double) region.samples / global_blend;
+        std::lock_guard<std::mutex> guard(global_lock);
+        for (int i = 0; i < NR_EVENTS; i++)
+            predicted[i] = weight * predicted[i] + (1.0 - weight) * llsp_predict(global_solvers->events[i].first, global);
     }
+}
+
+unsigned int govern_threads(void (*fn)(void *), void *data, unsigned int num_threads, long trip_count) {   // let the model of the function pick its number of threads
+    if (!thread_governor) return num_threads;
+
+    Region &region = register_function(fn);
+    unsigned int requested = num_threads > 0 ? num_threads : omp_features::Provider::get().default_team_size();
+    std::unique_lock<std::mutex> guard(region.lock);
+    double *metrics = get_metrics(region, data, requested);
+    bool trusted = region.samples >= GOVERNOR_MIN_SAMPLES;
+    guard.unlock();     // the callback takes it again, the governor calls it after releasing its own lock
+    auto decision = thread_governor->choose(reinterpret_cast<void *>(fn), requested, trusted,
+                                            [&](unsigned int threads, governor::Cost &cost) {
+        metrics[0] = threads;
+        if (runtime_features) metrics[1 + feature_width + omp_features::TEAM_SIZE] = threads;
+        double predicted[NR_EVENTS];
+        std::lock_guard<std::mutex> region_guard(region.lock);
+        predict_events(region, metrics, trip_count, predicted);
+        cost.time = predicted[event_index(Event::DURATION)];
+        cost.energy = predicted[event_index(Event::ENERGY)];
+        return true;
+    });
     free(metrics);
-    progress_file << std::endl;
-    
-    (*predictions[funcmap[fn]]) << std::endl;
 
-    perf_lock.lock();       // lock because monitoring thread also currently accesses the handles
-    perf_results = phandle->read();     // read out the current perf values to calculate the difference after the function execution
-    perf_results[EventNames[Event::ENERGY]] = ehandle->read();
-    perf_lock.unlock();
+    output_lock.lock();
+    governor_file << region.id << "," << requested << "," << decision.threads << "," << decision.explored << ","
+                  << decision.score << std::endl;
+    output_lock.unlock();
+    if (!decision.explored && decision.threads == requested) return num_threads;   // keep the default of the runtime
+    return decision.threads;
+}
+
+double predicted_miss_ratio(Region &region, const double *metrics, long trip_count) {    // cache misses per instruction
+    double predicted[NR_EVENTS];
+    std::lock_guard<std::mutex> guard(region.lock);
+    predict_events(region, metrics, trip_count, predicted);
+    double instructions = predicted[event_index(Event::INSTRUCTIONS)];
+    return instructions > 0 ? predicted[event_index(Event::CACHE_MISSES)] / instructions : 0.0;
+}
+
+void govern_frequency(void (*fn)(void *), void *data, unsigned int num_threads, long trip_count) {    // lower the frequency for memory-bound functions
+    if (!frequency_governor) return;
+
+    Region &region = register_function(fn);
+    std::unique_lock<std::mutex> guard(region.lock);
+    double miss_ratio = 0.0;
+    unsigned long khz = frequency_governor->nominal();     // no model yet, do not leave the previous function's frequency set
+    if (region.samples >= GOVERNOR_MIN_SAMPLES) {
+        double *metrics = get_metrics(region, data, num_threads);
+        guard.unlock();
+        miss_ratio = predicted_miss_ratio(region, metrics, trip_count);
+
+        khz = frequency_governor->choose(miss_ratio, [&](unsigned long khz, double &energy) {
+            if (!runtime_features) return false;    // the models only know the frequency as a runtime feature
+            metrics[1 + feature_width + omp_features::FREQUENCY] = khz;
+            double at_khz[NR_EVENTS];
+            std::lock_guard<std::mutex> region_guard(region.lock);
+            predict_events(region, metrics, trip_count, at_khz);
+            energy = at_khz[event_index(Event::ENERGY)];
+            return true;
+        });
+        free(metrics);
+    } else {
+        guard.unlock();
+    }
+
+    bool applied = frequency_governor->apply(reinterpret_cast<void *>(fn), khz);
+    output_lock.lock();
+    dvfs_file << region.id << "," << miss_ratio << "," << khz << "," << applied << std::endl;
+    output_lock.unlock();
+}
+
+// the query API predicts from a copy of the new model, blended with the global model as predict_events does,
+// the locks of the region and of the global model have to be held
+void publish_model(const Region &region, const double *const *coefficients, const double *const *global_coefficients,
+                   const double *results, long trip_count) {
+    graybox::Blend blend;
+    double weight = (double) region.samples / global_blend;
+    if (!global_coefficients || weight >= 1.0) {
+        graybox::publish(region.fn, coefficients, results, blend);
+        return;
+    }
+
+    std::vector<double> rows(NR_EVENTS * nr_metrics, 0.0);
+    const double *over_metrics[NR_EVENTS];
+    double bias[NR_EVENTS];
+    for (int i = 0; i < NR_EVENTS; i++) {
+        const double *k = global_coefficients[i];
+        over_metrics[i] = k ? &rows[i * nr_metrics] : nullptr;
+        bias[i] = 0.0;
+        if (!k) continue;
+        // get_global_metrics, written as a function of the metrics of the region
+        rows[i * nr_metrics] = k[1];
+        for (unsigned int m = 1; m <= feature_width; m++) rows[i * nr_metrics + m] = k[2];
+        bias[i] = k[0] + k[3] * (double) trip_count + k[4] * (double) region.size;
+    }
+    blend.weight = weight;
+    blend.coefficients = over_metrics;
+    blend.bias = bias;
+    graybox::publish(region.fn, coefficients, results, blend);
 }
 
-void end_perf_and_feed_predictor(void (*fn)(void *), void *data) {
-    perf_lock.lock();
+void predict_and_start_perf(RegionContext &call, void (*fn)(void *), void *data, unsigned int num_threads, long trip_count) {
+    call.overhead_start = overhead::own();
+    overhead::Stopwatch stopwatch;
+    Region &region = register_function(fn);
+    call.region = &region;
+    call.parent = current_call;
+    start_overlap_check(call);
+    stopwatch.lap(overhead::REGISTRATION);
+    std::cout << "here in func: " << region.id << std::endl;
+    stopwatch.lap(overhead::OUTPUT);
+
+    std::unique_lock<std::mutex> guard(region.lock);
+    FeatureMap &features = region.features;
+    if (features.offsets.size() < feature_width && features.scans < DISCOVERY_SCANS)
+        discover_features(features, data);     // look for addresses that can be found on the stack, once per call
+    call.metrics = get_metrics(region, data, num_threads);    // get workload metrics, the same ones are fed after the call
+    stopwatch.lap(overhead::METRICS);
+    predict_events(region, call.metrics, trip_count, call.predicted);
+    stopwatch.lap(overhead::PREDICTION);
+
+    for (int i = 0; i < NR_EVENTS; i++)
+        printf("predicted for %s: %f\n", EventNames[EventOrder[i]].c_str(), call.predicted[i]);
+
+    if (region.python) {
+        // the model is refit in the background, so record how stale the one that predicted was
+        double age = region.python->model_age();
+        uint64_t behind = region.python->samples_behind();
+        output_lock.lock();
+        model_age_file << region.id << "," << age << "," << behind << std::endl;
+        output_lock.unlock();
+        printf("model age: %fs, %lu samples behind\n", age, behind);
+    }
+    guard.unlock();
+    stopwatch.lap(overhead::OUTPUT);
+
+    call.counters = phandle->read();     // read out the current perf values to calculate the difference after the function execution
+    call.energy = ehandle->read();
+    stopwatch.lap(overhead::COUNTERS);
+    call.start = std::chrono::steady_clock::now();
+}
+
+void end_perf_and_feed_predictor(RegionContext &call, void *data, long trip_count) {
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - call.start;
+    overhead::Stopwatch stopwatch;
     auto perf_reading_end = phandle->read();    // read out the current perf values to calculate the difference
     auto energy_reading_end = ehandle->read();
-    perf_lock.unlock();
+    bool overlapping = overlapped(call);    // before this call leaves the count, so a later one still sees it
+    if (!call.parent) outermost_in_flight.fetch_sub(1);
+    stopwatch.lap(overhead::COUNTERS);
+    Region &region = *call.region;
 
     std::cout << "Performance results: " << std::endl;
 
-    if (current_predictor == PredictorNames[Predictor::LLSP]) {     // if LLSP
-        for (auto solver: llsp_solvers[fn].events) {    // for each perf value
-            double result;
-            if (solver.second == EventNames[Event::ENERGY]) {
-                result = (double) (energy_reading_end - perf_results[solver.second]);   // calculate the difference
-            } else {
-                result = (double) (perf_reading_end[solver.second] - perf_results[solver.second]);
-            }
-            std::cout << " " << solver.second << " -> " << result << std::endl;
-            (*measurements[funcmap[fn]]) << result << ",";      // save it in a file
-            llsp_add(solver.first, get_metrics(data), result);      // feed the predictor with it
-            llsp_solve(solver.first);
-        }
-    } else {
-        for (auto solver: python_solvers[fn].events) {
-            double result;
-            if (solver.second == EventNames[Event::ENERGY]) {
-                result = (double) (energy_reading_end - perf_results[solver.second]);
-            } else {
-                result = (double) (perf_reading_end[solver.second] - perf_results[solver.second]);
-            }
-            std::cout << " " << solver.second << " -> " << result << std::endl;
-            (*measurements[funcmap[fn]]) << result << ",";
-            solver.first->fit(get_metrics(data), NR_METRICS, result);
+    double results[NR_EVENTS];
+    for (int i = 0; i < NR_EVENTS; i++) {     // for each perf value
+        const std::string &name = EventNames[EventOrder[i]];
+        if (EventOrder[i] == Event::ENERGY) {
+            results[i] = (double) (energy_reading_end - call.energy);    // calculate the difference
+        } else if (EventOrder[i] == Event::DURATION) {
+            results[i] = duration.count();
+        } else {
+            perf::Counter counter = perf_counter(EventOrder[i]);
+            results[i] = (double) (perf_reading_end[counter] - call.counters[counter]);
         }
+        std::cout << " " << name << " -> " << results[i] << std::endl;
     }
+    stopwatch.lap(overhead::OUTPUT);
 
-    (*measurements[funcmap[fn]]) << std::endl;
+    // the counters count the whole process, so the values of a call include those of the calls inside it
+    double exclusive[NR_EVENTS];
+    for (int i = 0; i < NR_EVENTS; i++) {
+        exclusive[i] = std::max(0.0, results[i] - call.nested[i].load(std::memory_order_relaxed));
+        if (call.parent) call.parent->nested[i].fetch_add(results[i], std::memory_order_relaxed);
+    }
+
+    graybox::record(region.fn, call.predicted, results);
+    for (int i = 0; i < NR_EVENTS; i++) {
+        region.histograms.values[i].record(results[i]);
+        if (results[i] != 0) region.histograms.errors[i].record(std::fabs(call.predicted[i] - results[i]) / std::fabs(results[i]));
+    }
+
+    if (thread_governor && !overlapping)     // the governor learns how the cost of the function changes with its thread count
+        thread_governor->feed(reinterpret_cast<void *>(region.fn), (unsigned int) call.metrics[0],
+                              {results[event_index(Event::DURATION)], results[event_index(Event::ENERGY)]});
+
+    if (call.placed && !overlapping)     // only outermost functions are placed
+        placement_controller->feed(reinterpret_cast<void *>(region.fn), call.placement, results[event_index(Event::CACHE_MISSES)],
+                                   results[event_index(Event::ENERGY)], call.predicted[event_index(Event::CACHE_MISSES)],
+                                   call.predicted[event_index(Event::ENERGY)]);
+
+    std::unique_lock<std::mutex> guard(region.lock);
+    for (int i = 0; i < NR_EVENTS; i++) {
+        PredictionError &error = region.errors[i];
+        double absolute = std::fabs(call.predicted[i] - results[i]);
+        error.samples++;
+        error.absolute += absolute;
+        if (results[i] != 0) {
+            error.relative += absolute / std::fabs(results[i]);
+            error.relative_samples++;
+            error.max_relative = std::max(error.max_relative, absolute / std::fabs(results[i]));
+        }
+        region.attribution.inclusive[i] += results[i];
+        region.attribution.exclusive[i] += exclusive[i];
+    }
+    region.attribution.calls++;
+    if (call.parent) region.attribution.nested_calls++;
+    if (overlapping) region.attribution.overlapped_calls++;
+    stopwatch.lap(overhead::UPDATE);
+
+    if (!overlapping) learn_scalars(region, data, results);     // the values of an overlapped call are not its own
+    stopwatch.lap(overhead::METRICS);
+    double *metrics = call.metrics;     // the model learns from what it predicted with, as graybox-replay replays it
+    const double *coefficients[NR_EVENTS];
+    bool solved = false;
+    if (!overlapping && region.python) {
+        region.python->fit(metrics, results);      // feed all events with a single call
+    } else if (!overlapping && !daemon_feed(region, metrics, results)) {     // if LLSP
+        llsps_s &solvers = region_llsps(region);
+        for (int i = 0; i < NR_EVENTS; i++) {
+            llsp_add(solvers.events[i].first, metrics, results[i]);      // feed the predictor with it
+            if (region.changes) llsp_add(region.changes->events[i].first, metrics, results[i]);
+            coefficients[i] = llsp_solve(solvers.events[i].first);
+        }
+        prune_features(region);
+        solved = true;
+    }
+    if (!overlapping) region.samples++;
+
+    const double *global_coefficients[NR_EVENTS];
+    std::unique_lock<std::mutex> global_guard(global_lock, std::defer_lock);    // after the lock of the region, as in predict_events
+    if (global_solvers && !overlapping) {   // every function teaches the global model
+        double global[GLOBAL_METRICS];
+        get_global_metrics(region, metrics, trip_count, global);
+        global_guard.lock();
+        for (int i = 0; i < NR_EVENTS; i++) {
+            llsp_add(global_solvers->events[i].first, global, results[i]);
+            if (global_changes) llsp_add(global_changes->events[i].first, global, results[i]);
+            global_coefficients[i] = llsp_solve(global_solvers->events[i].first);
+        }
+    }
+    if (solved) publish_model(region, coefficients, global_solvers ? global_coefficients : nullptr, results, trip_count);
+    if (global_guard.owns_lock()) global_guard.unlock();
+    guard.unlock();
+    stopwatch.lap(overhead::UPDATE);
+
+    // all rows of a call at once, so the n-th row of progress.csv for a function stays the n-th row of its own files
+    output_lock.lock();
+    progress_file << region.id;     // which function was executed
+    for (unsigned int i = 0; i < nr_metrics; i++)
+        progress_file << "," << call.metrics[i];     // save the workload metrics that were used for post-mortem analysis
+    progress_file << std::endl;
+    for (int i = 0; i < NR_EVENTS; i++) {
+        region.predictions << call.predicted[i] << ",";     // save the predictions in a file for later evaluation
+        region.measurements << results[i] << ",";
+    }
+    region.predictions << std::endl;
+    region.measurements << std::endl;
+    output_lock.unlock();
+    free(call.metrics);
+    stopwatch.lap(overhead::OUTPUT);
+
+    overhead::Ticks now = overhead::own();
+    guard.lock();
+    RegionOverhead &cost = region.overhead;
+    for (int i = 0; i < overhead::COUNT; i++) cost.ticks[i] += now[i] - call.overhead_start[i];
+    cost.region_time += duration.count();
+    cost.calls++;
 }
 
 void clean_up_map() {   // now maps can be used and the content of the malloc array can be put in the malloc map
@@ -317,24 +1183,214 @@ void create_files() {   // for monitoring and post-mortem analysis
         std::cout << "failed to open monitoring or progress file" << std::endl;
         exit(1);
     }
-    progress_file << "Functions,Metrics,,,,,,,,," << std::endl;
+    progress_file << "Functions,Metrics" << std::string(nr_metrics - 1, ',') << std::endl;
+
+    regions_file.open("./csvs/regions.csv");
+    if (!regions_file.is_open()) {
+        std::cout << "failed to open regions file" << std::endl;
+        exit(1);
+    }
+    regions_file << "Functions,Key" << std::endl;
+
+    if (python_predictor()) {
+        model_age_file.open("./csvs/model_age.csv");
+        if (!model_age_file.is_open()) {
+            std::cout << "failed to open model age file" << std::endl;
+            exit(1);
+        }
+        model_age_file << "Functions,Model_Age,Samples_Behind" << std::endl;
+    }
+
+    if (thread_governor) {
+        governor_file.open("./csvs/governor.csv");
+        if (!governor_file.is_open()) {
+            std::cout << "failed to open governor file" << std::endl;
+            exit(1);
+        }
+        governor_file << "Functions,Requested,Threads,Explored,Score" << std::endl;
+    }
+
+    if (frequency_governor) {
+        dvfs_file.open("./csvs/dvfs.csv");
+        if (!dvfs_file.is_open()) {
+            std::cout << "failed to open dvfs file" << std::endl;
+            exit(1);
+        }
+        dvfs_file << "Functions,Miss_Ratio,Frequency,Applied" << std::endl;
+    }
 }
 
-void *perf_stuff(void *arg) {
-    monitoring_file << "Cache_Misses,Energy,Instructions," << std::endl;
-    while (running) {
-        perf_lock.lock();
-        std::map<std::string, uint64_t> new_perf_results = phandle->read();     // read out the new perf values
-        new_perf_results[EventNames[Event::ENERGY]] = ehandle->read();
-        perf_lock.unlock();
+void write_errors() {   // prediction error per function and event, e.g. to see how far a deadline can trust the duration
+    std::ofstream errors_file("./csvs/errors.csv");
+    if (!errors_file.is_open()) {
+        std::cout << "failed to open errors file" << std::endl;
+        return;
+    }
+    errors_file << "Functions,Event,Samples,Mean_Absolute_Error,Mean_Relative_Error,Max_Relative_Error" << std::endl;
+    std::shared_lock<std::shared_mutex> guard(regions_lock);
+    for (auto &[fn, region]: regions) {
+        std::lock_guard<std::mutex> region_guard(region->lock);
+        if (region->errors[0].samples == 0) continue;     // no call ended yet
+        for (int i = 0; i < NR_EVENTS; i++) {
+            const PredictionError &error = region->errors[i];
+            errors_file << region->id << "," << EventNames[EventOrder[i]] << "," << error.samples << ","
+                        << error.absolute / error.samples << ","
+                        << (error.relative_samples ? error.relative / error.relative_samples : 0.0) << ","
+                        << error.max_relative << std::endl;
+        }
+    }
+}
+
+void write_attribution() {  // events per function with and without the calls that ran inside its calls
+    std::ofstream attribution_file("./csvs/attribution.csv");
+    if (!attribution_file.is_open()) {
+        std::cout << "failed to open attribution file" << std::endl;
+        return;
+    }
+    attribution_file << "Functions,Event,Calls,Nested_Calls,Overlapped_Calls,Inclusive,Exclusive" << std::endl;
+    std::shared_lock<std::shared_mutex> guard(regions_lock);
+    for (auto &[fn, region]: regions) {
+        std::lock_guard<std::mutex> region_guard(region->lock);
+        const RegionAttribution &attribution = region->attribution;
+        if (attribution.calls == 0) continue;
+        for (int i = 0; i < NR_EVENTS; i++) {
+            attribution_file << region->id << "," << EventNames[EventOrder[i]] << "," << attribution.calls << ","
+                             << attribution.nested_calls << "," << attribution.overlapped_calls << ","
+                             << attribution.inclusive[i] << ","
+                             << attribution.exclusive[i] << std::endl;
+        }
+    }
+}
 
-        for (auto &[name, val]: thread_results) {
+void write_histograms() {   // tail percentiles of each event and prediction error per function, at teardown and on SIGUSR1
+    std::ofstream histogram_file("./csvs/histograms.csv");
+    if (!histogram_file.is_open()) {
+        std::cout << "failed to open histograms file" << std::endl;
+        return;
+    }
+    histogram_file << "Functions,Event,Kind,Count,P50,P90,P99,Max" << std::endl;
+    std::shared_lock<std::shared_mutex> guard(regions_lock);     // only keeps a function from being added meanwhile
+    for (auto &[fn, region]: regions) {
+        for (int i = 0; i < NR_EVENTS; i++) {
+            for (auto &[kind, h]: {std::make_pair("Value", &region->histograms.values[i]),
+                                   std::make_pair("Relative_Error", &region->histograms.errors[i])}) {
+                histogram_file << region->id << "," << EventNames[EventOrder[i]] << "," << kind << ","
+                               << h->count() << "," << h->percentile(0.5) << "," << h->percentile(0.9) << ","
+                               << h->percentile(0.99) << "," << h->max() << std::endl;
+            }
+        }
+    }
+}
+
+void request_histogram_dump(int) {     // only sets a flag, writing files is not async-signal-safe
+    histogram_dump_requested.store(true, std::memory_order_relaxed);
+}
 
-            double result = (double) (new_perf_results[name] - val);    // calculate the difference
+void write_overhead() {   // own time of my_omp.so per function and phase, and in total, against the time of the functions
+    std::ofstream overhead_file("./csvs/overhead.csv");
+    if (!overhead_file.is_open()) {
+        std::cout << "failed to open overhead file" << std::endl;
+        return;
+    }
+    overhead_file << "Functions,Calls,Region_Time";
+    for (auto name: overhead::PhaseNames) overhead_file << "," << name;
+    overhead_file << ",Overhead,Overhead_Percent" << std::endl;
+
+    auto write_row = [&](const std::string &id, uint64_t calls, double region_time, const overhead::Ticks &ticks) {
+        overhead_file << id << "," << calls << "," << region_time;
+        double total = 0.0;
+        for (auto t: ticks) {
+            overhead_file << "," << overhead::seconds(t);
+            total += overhead::seconds(t);
+        }
+        overhead_file << "," << total << "," << (region_time > 0 ? 100 * total / region_time : 0.0) << std::endl;
+    };
+
+    uint64_t calls = 0;
+    double region_time = 0.0;
+    std::shared_lock<std::shared_mutex> guard(regions_lock);
+    for (auto &[fn, region]: regions) {
+        std::lock_guard<std::mutex> region_guard(region->lock);
+        const RegionOverhead &cost = region->overhead;
+        write_row(std::to_string(region->id), cost.calls, cost.region_time, cost.ticks);
+        calls += cost.calls;
+        region_time += cost.region_time;
+    }
+    write_row("all", calls, region_time, overhead::all());     // all threads, including malloc calls outside of the boundaries
+}
+
+void write_memory() {     // memory of my_omp.so's own, from the arena and passed on by the malloc hook
+    std::ofstream memory_file("./csvs/memory.csv");
+    if (!memory_file.is_open()) {
+        std::cout << "failed to open memory file" << std::endl;
+        return;
+    }
+    memory_file << "Pool,Block_Size,Allocations,Bytes,In_Use,Peak,Mapped" << std::endl;
+    auto write_row = [&](const std::string &pool, const arena::Usage &usage) {
+        memory_file << pool << "," << usage.size << "," << usage.allocations << "," << usage.bytes << ","
+                    << usage.in_use << "," << usage.peak << "," << usage.mapped << std::endl;
+    };
+    for (size_t i = 0; i < arena::CLASSES; i++) write_row("arena", arena::usage(i));
+    write_row("arena_large", arena::usage(arena::CLASSES));
+    write_row("malloc", arena::forwarded_usage());
+}
+
+void write_fit_times() {   // how much time the python predictors spent in refits, per function
+    std::ofstream fit_time_file("./csvs/fit_time.csv");
+    if (!fit_time_file.is_open()) {
+        std::cout << "failed to open fit time file" << std::endl;
+        return;
+    }
+    fit_time_file << "Functions,Samples,Refits,Full_Refits,Fit_Time" << std::endl;
+    std::shared_lock<std::shared_mutex> guard(regions_lock);
+    for (auto &[fn, region]: regions) {
+        if (!region->python) continue;
+        python::Predictor *solver = region->python;
+        fit_time_file << region->id << "," << solver->samples() << "," << solver->refit_count() << ","
+                      << solver->full_refit_count() << "," << solver->fit_time() << std::endl;
+    }
+}
+
+void write_schedules() {    // which schedule each schedule(runtime) loop ended up with and what it gained
+    std::ofstream schedule_file("./csvs/schedule.csv");
+    if (!schedule_file.is_open()) {
+        std::cout << "failed to open schedule file" << std::endl;
+        return;
+    }
+    tuner->report(schedule_file, function_id);
+}
+
+void write_placements() {   // how each function was placed and what it measured with each policy
+    std::ofstream placement_file("./csvs/placement.csv");
+    if (!placement_file.is_open()) {
+        std::cout << "failed to open placement file" << std::endl;
+        return;
+    }
+    placement_controller->report(placement_file, function_id);
+}
+
+void *perf_stuff(void *arg) {
+    arena::Scope internal;      // the whole thread is my_omp.so's
+    monitoring_file << "Cache_Misses,Cycles,Energy,Instructions,Ref_Cycles," << std::endl;    // ordered by name
+    const Event columns[] = {Event::CACHE_MISSES, Event::CYCLES, Event::ENERGY, Event::INSTRUCTIONS, Event::REF_CYCLES};
+    perf::Values last{};
+    uint64_t last_energy = 0;
+    while (running) {
+        // its own fds, so a region entry or exit never waits for this read
+        perf::Values current = monitor_phandle ? monitor_phandle->read() : perf::Values{};
+        uint64_t energy = monitor_ehandle->read();
+
+        for (Event event: columns) {
+            perf::Counter counter = perf_counter(event);
+            double result = event == Event::ENERGY ? (double) (energy - last_energy)
+                                                   : (double) (current[counter] - last[counter]);    // calculate the difference
             monitoring_file << result << std::fixed << ",";
-            thread_results[name] = new_perf_results[name];  // save the new perf values
         }
+        last = current;
+        last_energy = energy;
         monitoring_file << std::endl;
+        if (runtime_features) omp_features::Provider::get().refresh_frequency();
+        if (histogram_dump_requested.exchange(false, std::memory_order_relaxed)) write_histograms();
         usleep(50000);  // sleep for 50 ms
     }
     return nullptr;
@@ -342,11 +1398,54 @@ void *perf_stuff(void *arg) {
 
 extern "C" void
 __attribute__((constructor(65535))) setup(void) {   // is executed after all other constructors are executed and before main starts
+    arena::Scope internal;
     current_predictor = getenv("PREDICTOR") ?: "llsp";      // get the predictor that should be used
 
     std::cout << "predictor: " << current_predictor << std::endl;
 
-    if (current_predictor != PredictorNames[Predictor::LLSP]) python::init();   // if it is a python predictor, init is needed
+    if (getenv("FEATURE_WIDTH")) feature_width = atoi(getenv("FEATURE_WIDTH"));     // number of array sizes per function
+    runtime_features = !getenv("RUNTIME_FEATURES") || atoi(getenv("RUNTIME_FEATURES")) != 0;
+    if (getenv("SCALAR_WIDTH")) scalar_width = atoi(getenv("SCALAR_WIDTH"));     // number of integer fields per function
+    scalar_start = feature_width + 1 + (runtime_features ? omp_features::COUNT : 0);
+    nr_metrics = scalar_start + scalar_width;
+    if (getenv("FEATURE_PRUNE")) prune_after = atoi(getenv("FEATURE_PRUNE"));
+    llsp_defaults = llsp_default_params();
+    if (getenv("LLSP_AGING")) llsp_defaults.aging = atof(getenv("LLSP_AGING"));
+    if (getenv("LLSP_CONTRIBUTION")) llsp_defaults.contribution = atof(getenv("LLSP_CONTRIBUTION"));
+    if (getenv("LLSP_PARAMS")) parse_llsp_params(getenv("LLSP_PARAMS"));
+    if (!getenv("STATIC_DATA") || atoi(getenv("STATIC_DATA")) != 0) {
+        static_data = elf_util::StaticData::of_loaded_modules(STATIC_MIN_BYTES);
+        LOGGER->info("%zu static data objects\n", static_data.size());
+    }
+
+    std::vector<std::string> event_names;
+    for (auto event: EventOrder) event_names.push_back(EventNames[event]);
+    graybox::init(nr_metrics, event_names);     // the query API, see graybox.h
+
+    if (current_predictor == PredictorNames[Predictor::DAEMON]) {     // connect to the daemon, without one predict locally
+        const char *socket = getenv("DAEMON_SOCKET") ?: daemon_protocol::DEFAULT_SOCKET;
+        daemon_conn = daemon_client::Client::connect(socket, nr_metrics, NR_EVENTS);
+        if (!daemon_conn) {
+            LOGGER->warning("Predictor daemon not available, using llsp\n");
+            current_predictor = PredictorNames[Predictor::LLSP].c_str();
+        }
+    }
+
+    if (python_predictor()) python::init();   // if it is a python predictor, init is needed
+
+    if (getenv("MODEL_STORE")) store = std::make_unique<model_store::Store>(getenv("MODEL_STORE"));   // load the models of previous runs
+
+    thread_governor = governor::ThreadGovernor::from_env(omp_features::Provider::get().default_team_size());
+    frequency_governor = dvfs::FrequencyGovernor::from_env();
+    tuner = schedule_tuner::ScheduleTuner::from_env();
+    placement_controller = placement::Controller::from_env();
+
+    global_blend = getenv("GLOBAL_BLEND") ? atoi(getenv("GLOBAL_BLEND")) : 5;
+    if (global_blend > 0) {
+        global_solvers = std::make_unique<llsps_s>(GLOBAL_METRICS);
+        if (store) global_changes = std::make_unique<llsps_s>(GLOBAL_METRICS);
+        restore_global_model();
+    }
 
     accessible_and_count_lock.lock();
     accessible = true;      // now the malloc map can be used
@@ -358,18 +1457,54 @@ __attribute__((constructor(65535))) setup(void) {   // is executed after all oth
 
     create_files();
 
-    pthread_t perf_thread;      // create the monitoring thread
-    pthread_create(&perf_thread, nullptr, perf_stuff, nullptr);
+    struct sigaction current{};
+    if (sigaction(SIGUSR1, nullptr, &current) == 0 && current.sa_handler == SIG_DFL)   // leave a handler of the program alone
+        signal(SIGUSR1, request_histogram_dump);
+
+    perf_thread_started = pthread_create(&perf_thread, nullptr, perf_stuff, nullptr) == 0;    // create the monitoring thread
+    pthread_atfork(nullptr, nullptr, [] { perf_thread_started = false; });     // a forked child has no monitoring thread to join
 }
 
 extern "C" void
 __attribute__((destructor)) teardown(void) { // is executed after program terminates
+    arena::Scope internal;
     running = false;
+    if (perf_thread_started) pthread_join(perf_thread, nullptr);    // it may be writing a histogram dump or a monitoring row
+
+    if (python_predictor()) write_fit_times();
+    write_features();
+    write_scalars();
+    write_errors();
+    write_attribution();
+    write_histograms();
+    write_overhead();
+    write_memory();
+
+    if (daemon_conn) daemon_conn->flush();     // hand the last measurements to the daemon
+
+    save_models();
+
+    if (tuner) write_schedules();
+    if (placement_controller) write_placements();
+
+    if (frequency_governor) frequency_governor->restore();     // leave the frequencies as the program found them
 }
 
+std::atomic<void *(*)(size_t)> real_malloc{nullptr};    // looked up by the first call, not by every call
+
 extern "C" void *
 malloc(size_t __size) {
-    void *address = ((void *(*)(size_t)) dlsym(RTLD_NEXT, "malloc"))(__size);   // call the real malloc
+    auto real = real_malloc.load(std::memory_order_relaxed);
+    if (!real) {
+        real = (void *(*)(size_t)) dlsym(RTLD_NEXT, "malloc");
+        real_malloc.store(real, std::memory_order_relaxed);
+    }
+    void *address = real(__size);   // call the real malloc
+    overhead::Scope scope(overhead::MALLOC);    // only the bookkeeping, the real malloc is the program's own cost
+    if (arena::internal()) {    // my_omp.so's own, it stays out of the malloc map
+        arena::forwarded(__size);
+        return address;
+    }
     accessible_and_count_lock.lock();
     int position = count;
     if (accessible) {   // if maps can be used
@@ -409,17 +1544,248 @@ omp_set_num_threads(int set_thread_num) {
     thread_num_lock.unlock();
 }
 
+/* Runs a call of an outermost region with the schedule the tuner picks for it. Its team starts its
+ * schedule(runtime) loops through runtime_loop_start, which takes the schedule from the context of the call. */
+template<typename Call>
+void tune_schedule(RegionContext &context, void (*fn)(void *), long trips, Call call) {
+    if (!tuner || omp_get_level() > 0) {
+        call(nullptr);
+        return;
+    }
+
+    size_t index = tuner->choose(reinterpret_cast<void *>(fn), trips);
+    context.runtime_trip_count.store(trips, std::memory_order_relaxed);
+    context.schedule = &tuner->config(index);     // published to the team by the thread start
+
+    uint64_t energy_start = ehandle->read();
+    auto begin = std::chrono::steady_clock::now();
+
+    call(context.schedule);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    uint64_t energy_end = ehandle->read();
+
+    bool own = !overlapped(context);     // the energy of an overlapped call is not its own
+    if (own && (context.runtime_schedule_seen.load(std::memory_order_relaxed) || trips > 0))  // regions without such a loop are not tuned
+        tuner->feed(reinterpret_cast<void *>(fn), index, context.runtime_trip_count.load(std::memory_order_relaxed),
+                    {elapsed.count(), (double) (energy_end - energy_start)});
+}
+
+struct PinnedCall {     // what the threads of a placed function run
+    void (*fn)(void *);
+    void *data;
+    placement::Policy policy;
+};
+
+void pinned_function(void *arg) {    // every thread of the team pins itself before it runs the actual function
+    auto call = (PinnedCall *) arg;
+    placement_controller->pin(call->policy, omp_get_thread_num());
+    call->fn(call->data);
+}
+
+/* Runs a call of an outermost function with its threads placed by the controller, through pinned_function. */
+template<typename Call>
+void place_threads(RegionContext &context, void (*fn)(void *), void *data, unsigned num_threads, long trip_count, Call call) {
+    if (!placement_controller || omp_get_level() > 0) {
+        call(fn, data);
+        return;
+    }
+
+    Region &region = register_function(fn);
+    region.lock.lock();
+    bool trusted = region.samples >= GOVERNOR_MIN_SAMPLES;
+    region.lock.unlock();
+    auto policy = placement_controller->choose(reinterpret_cast<void *>(fn), trusted, [&]() {
+        region.lock.lock();
+        double *metrics = get_metrics(region, data, num_threads);
+        region.lock.unlock();
+        double miss_ratio = predicted_miss_ratio(region, metrics, trip_count);
+        free(metrics);
+        return miss_ratio;
+    });
+    context.placed = true;
+    context.placement = policy;
+    PinnedCall pinned{fn, data, policy};
+    placement::SavedAffinity affinity(*placement_controller);     // this thread becomes thread 0 of the team and is pinned as well
+    call(pinned_function, &pinned);
+}
+
+struct TeamCall {    // what the threads of a team run, so that the calls they start find their parent
+    void (*fn)(void *);
+    void *data;
+    RegionContext *call;
+};
+
+void team_function(void *arg) {     // every thread of the team runs inside the call of the team until the function returns
+    auto team = (TeamCall *) arg;
+    RegionContext *outer = current_call;    // threads of a pool join the teams of different calls
+    current_call = team->call;
+    team->fn(team->data);
+    current_call = outer;
+}
+
 extern "C" void
 GOMP_parallel(void (*fn)(void *), void *data, unsigned num_threads,
               unsigned int flags) {
 
     auto func = (void (*)(void (*)(void *), void *, unsigned, unsigned int)) dlsym(RTLD_NEXT, "GOMP_parallel");     // get the real GOMP_parallel
+    arena::Scope internal;      // until the real call starts, the team's allocations are the program's
+
+    num_threads = govern_threads(fn, data, num_threads, 0);     // only changes it if a governor is set
+    govern_frequency(fn, data, num_threads, 0);
 
-    predict_and_start_perf(fn, data);   // make predictions about the function that will be run right away and start perf for measuring
+    RegionContext call;
+    predict_and_start_perf(call, fn, data, num_threads, 0);   // make predictions about the function that will be run right away and start perf for measuring
 
-    func(fn, data, num_threads, flags); // call the function
+    tune_schedule(call, fn, 0, [&](const schedule_tuner::Config *) {
+        place_threads(call, fn, data, num_threads, 0, [&](void (*run)(void *), void *arg) {
+            TeamCall team{run, arg, &call};
+            arena::Scope program(false);
+            func(team_function, &team, num_threads, flags); // call the function, its loops pick up the tuned schedule
+        });
+    });
 
-    end_perf_and_feed_predictor(fn, data);  // end perf for feeding the actual values in the predictor
+    end_perf_and_feed_predictor(call, data, 0);  // end perf for feeding the actual values in the predictor
 
     printf("------------------------------------\n");
 }
+
+long trip_count(long start, long end, long incr) {     // number of iterations of a loop as libgomp gets it
+    if (incr > 0) return start < end ? (end - start + incr - 1) / incr : 0;
+    return start > end ? (start - end - incr - 1) / -incr : 0;
+}
+
+/* Combined parallel loops (#pragma omp parallel for with a non-static schedule) do not go through
+ * GOMP_parallel, the trip count they pass is a feature for the global model. */
+template<typename Call>
+void run_loop(void (*fn)(void *), void *data, unsigned num_threads, long trips, Call call) {
+    arena::Scope internal;      // call makes the real call as the program
+    num_threads = govern_threads(fn, data, num_threads, trips);
+    govern_frequency(fn, data, num_threads, trips);
+    RegionContext context;
+    predict_and_start_perf(context, fn, data, num_threads, trips);
+
+    place_threads(context, fn, data, num_threads, trips, [&](void (*run)(void *), void *arg) {
+        TeamCall team{run, arg, &context};
+        call(context, num_threads, team_function, &team);
+    });
+
+    end_perf_and_feed_predictor(context, data, trips);
+
+    printf("------------------------------------\n");
+}
+
+template<typename... Args>
+void parallel_loop(const char *name, void (*fn)(void *), void *data, unsigned num_threads,
+                   long start, long end, long incr, Args... args) {
+    auto func = (void (*)(void (*)(void *), void *, unsigned, long, long, long, Args...)) dlsym(RTLD_NEXT, name);
+
+    run_loop(fn, data, num_threads, trip_count(start, end, incr), [&](RegionContext &, unsigned threads, void (*run)(void *), void *arg) {
+        arena::Scope program(false);
+        func(run, arg, threads, start, end, incr, args...);
+    });
+}
+
+/* schedule(runtime) loops leave the schedule to us: with a tuner, a combined loop is started through
+ * the entry point of the schedule the tuner picked, which sets up the work share the same way. */
+void runtime_loop(const char *name, void (*fn)(void *), void *data, unsigned num_threads,
+                  long start, long end, long incr, unsigned flags) {
+    if (!tuner) {
+        parallel_loop(name, fn, data, num_threads, start, end, incr, flags);
+        return;
+    }
+
+    long trips = trip_count(start, end, incr);
+    run_loop(fn, data, num_threads, trips, [&](RegionContext &context, unsigned threads, void (*run)(void *), void *arg) {
+        tune_schedule(context, fn, trips, [&](const schedule_tuner::Config *config) {
+            arena::Scope program(false);
+            if (config && config->parallel_symbol()) {
+                auto func = (void (*)(void (*)(void *), void *, unsigned, long, long, long, long, unsigned)) dlsym(RTLD_NEXT, config->parallel_symbol());
+                func(run, arg, threads, start, end, incr, config->chunk, flags);
+            } else {
+                auto func = (void (*)(void (*)(void *), void *, unsigned, long, long, long, unsigned)) dlsym(RTLD_NEXT, name);
+                func(run, arg, threads, start, end, incr, flags);
+            }
+        });
+    });
+}
+
+extern "C" void
+GOMP_parallel_loop_static(void (*fn)(void *), void *data, unsigned num_threads,
+                          long start, long end, long incr, long chunk_size, unsigned flags) {
+    parallel_loop("GOMP_parallel_loop_static", fn, data, num_threads, start, end, incr, chunk_size, flags);
+}
+
+extern "C" void
+GOMP_parallel_loop_dynamic(void (*fn)(void *), void *data, unsigned num_threads,
+                           long start, long end, long incr, long chunk_size, unsigned flags) {
+    parallel_loop("GOMP_parallel_loop_dynamic", fn, data, num_threads, start, end, incr, chunk_size, flags);
+}
+
+extern "C" void
+GOMP_parallel_loop_guided(void (*fn)(void *), void *data, unsigned num_threads,
+                          long start, long end, long incr, long chunk_size, unsigned flags) {
+    parallel_loop("GOMP_parallel_loop_guided", fn, data, num_threads, start, end, incr, chunk_size, flags);
+}
+
+extern "C" void
+GOMP_parallel_loop_nonmonotonic_dynamic(void (*fn)(void *), void *data, unsigned num_threads,
+                                        long start, long end, long incr, long chunk_size, unsigned flags) {
+    parallel_loop("GOMP_parallel_loop_nonmonotonic_dynamic", fn, data, num_threads, start, end, incr, chunk_size, flags);
+}
+
+extern "C" void
+GOMP_parallel_loop_nonmonotonic_guided(void (*fn)(void *), void *data, unsigned num_threads,
+                                       long start, long end, long incr, long chunk_size, unsigned flags) {
+    parallel_loop("GOMP_parallel_loop_nonmonotonic_guided", fn, data, num_threads, start, end, incr, chunk_size, flags);
+}
+
+extern "C" void
+GOMP_parallel_loop_runtime(void (*fn)(void *), void *data, unsigned num_threads,
+                           long start, long end, long incr, unsigned flags) {
+    runtime_loop("GOMP_parallel_loop_runtime", fn, data, num_threads, start, end, incr, flags);
+}
+
+extern "C" void
+GOMP_parallel_loop_nonmonotonic_runtime(void (*fn)(void *), void *data, unsigned num_threads,
+                                        long start, long end, long incr, unsigned flags) {
+    runtime_loop("GOMP_parallel_loop_nonmonotonic_runtime", fn, data, num_threads, start, end, incr, flags);
+}
+
+extern "C" void
+GOMP_parallel_loop_maybe_nonmonotonic_runtime(void (*fn)(void *), void *data, unsigned num_threads,
+                                              long start, long end, long incr, unsigned flags) {
+    runtime_loop("GOMP_parallel_loop_maybe_nonmonotonic_runtime", fn, data, num_threads, start, end, incr, flags);
+}
+
+/* schedule(runtime) loops that are not combined with their parallel region start inside the outlined
+ * function, from every thread of the team. */
+bool runtime_loop_start(const char *name, long start, long end, long incr, long *istart, long *iend) {
+    RegionContext *call = current_call;     // the outermost call, the thread runs in its team
+    if (tuner && omp_get_level() == 1 && call) {
+        call->runtime_schedule_seen.store(true, std::memory_order_relaxed);
+        call->runtime_trip_count.store(trip_count(start, end, incr), std::memory_order_relaxed);
+        auto config = call->schedule;
+        if (config && config->start_symbol()) {
+            auto func = (bool (*)(long, long, long, long, long *, long *)) dlsym(RTLD_NEXT, config->start_symbol());
+            return func(start, end, incr, config->chunk, istart, iend);
+        }
+    }
+    auto func = (bool (*)(long, long, long, long *, long *)) dlsym(RTLD_NEXT, name);
+    return func(start, end, incr, istart, iend);
+}
+
+extern "C" bool
+GOMP_loop_runtime_start(long start, long end, long incr, long *istart, long *iend) {
+    return runtime_loop_start("GOMP_loop_runtime_start", start, end, incr, istart, iend);
+}
+
+extern "C" bool
+GOMP_loop_nonmonotonic_runtime_start(long start, long end, long incr, long *istart, long *iend) {
+    return runtime_loop_start("GOMP_loop_nonmonotonic_runtime_start", start, end, incr, istart, iend);
+}
+
+extern "C" bool
+GOMP_loop_maybe_nonmonotonic_runtime_start(long start, long end, long incr, long *istart, long *iend) {
+    return runtime_loop_start("GOMP_loop_maybe_nonmonotonic_runtime_start", start, end, incr, istart, iend);
+}
@@ -0,0 +1,77 @@
+#include "omp_features.h"
+#include "debug_util.h"
+#include "dvfs.h"
+
+#include <string>
+
+#include <omp.h>
+#include <sched.h>      // sched_getcpu
+
+
+namespace omp_features {
+
+    const char *const Names[COUNT] = {"Schedule", "Chunk", "Proc_Bind", "Places", "Level", "Dynamic", "Team_Size",
+                                      "Frequency"};
+
+    Provider::Provider() : _stale{true}, _icvs{}, _cpu{-1}, _frequency{0.0}, _has_cpufreq{true} {}
+
+    Provider &Provider::get() {
+        static Provider provider;
+        return provider;
+    }
+
+    void Provider::refresh_frequency() {
+        int cpu = _cpu.load(std::memory_order_relaxed);
+        if (cpu < 0 || !_has_cpufreq)
+            return;
+
+        std::string path = dvfs::cpufreq_root() + "/cpu" + std::to_string(cpu) + "/cpufreq/scaling_cur_freq";
+        FILE *file = fopen(path.c_str(), "r");
+        unsigned long khz = 0;
+        if (!file || fscanf(file, "%lu", &khz) != 1) {
+            LOGGER->warning("No cpufreq for cpu %d, the frequency feature stays 0\n", cpu);
+            _has_cpufreq = false;
+        } else {
+            _frequency.store((double) khz, std::memory_order_relaxed);
+        }
+        if (file) fclose(file);
+    }
+
+    void Provider::update() {
+        if (!_stale)
+            return;
+
+        _icvs[PROC_BIND] = (double) omp_get_proc_bind();
+        _icvs[PLACES] = (double) omp_get_num_places();
+        _stale = false;
+    }
+
+    unsigned int Provider::default_team_size() {
+        return (unsigned int) omp_get_max_threads();    // of the calling thread at its level
+    }
+
+    void Provider::fill(unsigned int num_threads, double *features) {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            update();
+            features[PROC_BIND] = _icvs[PROC_BIND];
+            features[PLACES] = _icvs[PLACES];
+        }
+
+        // the ICVs of the thread that starts the region, another thread or level may have other ones
+        omp_sched_t kind;
+        int chunk;
+        omp_get_schedule(&kind, &chunk);
+        features[SCHEDULE] = (double) (kind & ~omp_sched_monotonic);
+        features[CHUNK] = (double) chunk;
+        features[DYNAMIC] = (double) omp_get_dynamic();
+        features[TEAM_SIZE] = (double) omp_get_max_threads();
+        features[LEVEL] = (double) omp_get_level();
+        if (num_threads > 0)
+            features[TEAM_SIZE] = (double) num_threads;     // a num_threads clause overrides the default
+
+        _cpu.store(sched_getcpu(), std::memory_order_relaxed);
+        features[FREQUENCY] = _frequency.load(std::memory_order_relaxed);
+    }
+
+} /* namespace omp_features */
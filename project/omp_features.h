@@ -0,0 +1,67 @@
+#ifndef __OMP_FEATURES_H__
+#define __OMP_FEATURES_H__
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+namespace omp_features {
+
+    enum Feature {
+        SCHEDULE  = 0,      // kind of schedule(runtime), without the monotonic modifier
+        CHUNK     = 1,      // chunk size of schedule(runtime)
+        PROC_BIND = 2,      // omp_proc_bind_t of the next region
+        PLACES    = 3,      // number of places in the place list
+        LEVEL     = 4,      // nesting level the region is started from
+        DYNAMIC   = 5,      // dynamic adjustment of the team size enabled
+        TEAM_SIZE = 6,      // requested team size, the default one if GOMP_parallel got 0
+        FREQUENCY = 7,      // current frequency of the core the region is started on, in kHz
+        COUNT     = 8
+    };
+
+    extern const char *const Names[COUNT];
+
+/* \brief Samples the OpenMP runtime and platform state as prediction features
+ *
+ * The schedule, the dynamic flag and the default team size are internal
+ * control variables of the calling thread and nesting level, so they are read
+ * on the thread that starts the region, which costs no more than a load. The
+ * place list and the binding policy come from the environment, are the same
+ * for the whole process and have no setter, so they are read once. The CPU
+ * frequency is read from cpufreq by the monitoring thread, fill() only looks
+ * at the last value it read. */
+    class Provider {
+    private:
+        std::mutex _lock;
+        bool _stale;
+        double _icvs[COUNT];                // cached values of the features that come from process-wide ICVs
+        std::atomic<int> _cpu;              // core the last region was started on
+        std::atomic<double> _frequency;
+        bool _has_cpufreq;
+
+        Provider();
+
+        /* Reads the process-wide ICVs on the first call, _lock must be held. */
+        void update();
+
+    public:
+        Provider(const Provider &) = delete;
+
+        Provider &operator=(const Provider &) = delete;
+
+        static Provider &get();
+
+        /* Reads the current frequency of the core the last region was started on. */
+        void refresh_frequency();
+
+        /* Writes COUNT features for a region started with the given GOMP_parallel num_threads argument. */
+        void fill(unsigned int num_threads, double *features);
+
+        /* Number of threads a region gets if GOMP_parallel is called with 0. */
+        unsigned int default_team_size();
+    };
+
+} /* namespace omp_features */
+
+#endif /* __OMP_FEATURES_H__ */
@@ -0,0 +1,64 @@
+#include "overhead.h"
+
+#include <atomic>
+
+#define OVERHEAD_THREADS 256    // threads with a slot of their own
+
+namespace overhead {
+
+    const char *const PhaseNames[COUNT] = {"Metrics", "Prediction", "Counters", "Output", "Update", "Registration", "Malloc"};
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> ticks[COUNT];
+    };
+
+    static Slot slots[OVERHEAD_THREADS];    // zeroed before any constructor runs
+    static std::atomic<unsigned int> claimed{0};
+
+    /* initial-exec, the lazy allocation of dynamic TLS could call malloc from within the malloc hook */
+    static thread_local Slot *own_slot __attribute__ ((tls_model("initial-exec"))) = nullptr;
+    static thread_local bool shared __attribute__ ((tls_model("initial-exec"))) = false;
+
+    struct Origin {
+        uint64_t ticks = now();
+        std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    };
+    static const Origin origin;
+
+    static Slot *slot() {
+        if (!own_slot) {
+            unsigned int index = claimed.fetch_add(1, std::memory_order_relaxed);
+            shared = index >= OVERHEAD_THREADS - 1;
+            own_slot = &slots[shared ? OVERHEAD_THREADS - 1 : index];
+        }
+        return own_slot;
+    }
+
+    void add(Phase phase, uint64_t ticks) {
+        std::atomic<uint64_t> &counter = slot()->ticks[phase];
+        if (shared)
+            counter.fetch_add(ticks, std::memory_order_relaxed);
+        else    // only this thread writes, readers only need untorn values
+            counter.store(counter.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+    }
+
+    Ticks own() {
+        Ticks ticks;
+        for (int i = 0; i < COUNT; i++) ticks[i] = slot()->ticks[i].load(std::memory_order_relaxed);
+        return ticks;
+    }
+
+    Ticks all() {
+        Ticks ticks{};
+        for (auto &s: slots)
+            for (int i = 0; i < COUNT; i++) ticks[i] += s.ticks[i].load(std::memory_order_relaxed);
+        return ticks;
+    }
+
+    double seconds(uint64_t ticks) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - origin.time;
+        uint64_t elapsed_ticks = now() - origin.ticks;
+        return elapsed_ticks ? ticks * (elapsed.count() / elapsed_ticks) : 0.0;
+    }
+
+} /* namespace overhead */
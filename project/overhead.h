@@ -0,0 +1,89 @@
+#ifndef __OVERHEAD_H__
+#define __OVERHEAD_H__
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  // __rdtsc
+#endif
+
+/* \brief Time my_omp.so spends on its own work, by phase
+ *
+ * Phases are timed with the time stamp counter and added to counters of the
+ * calling thread, so timing needs neither a lock nor a shared cache line and
+ * can stay on in production. Each thread claims a slot of a fixed table the
+ * first time it adds something, nothing is allocated, which keeps it usable
+ * from the malloc hook. Threads beyond the table share its last slot. */
+namespace overhead {
+
+    enum Phase {
+        METRICS    = 0,     // extracting the metrics of a region
+        PREDICTION = 1,     // asking the predictor
+        COUNTERS   = 2,     // reading the perf and energy counters
+        OUTPUT     = 3,     // csvs and console output
+        UPDATE     = 4,     // feeding the measurements to the models
+        REGISTRATION = 5,   // looking up a region, and setting up its models the first time
+        MALLOC     = 6,     // bookkeeping of the malloc hook
+        COUNT      = 7
+    };
+
+    extern const char *const PhaseNames[COUNT];
+
+    using Ticks = std::array<uint64_t, COUNT>;
+
+    inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void add(Phase phase, uint64_t ticks);
+
+    /* Ticks of each phase of the calling thread so far. */
+    Ticks own();
+
+    /* Ticks of each phase of all threads so far. */
+    Ticks all();
+
+    /* Ticks in seconds, calibrated against the steady clock since the library was loaded. */
+    double seconds(uint64_t ticks);
+
+/* \brief Charges the time since construction to a phase when it goes out of scope */
+    class Scope {
+        Phase _phase;
+        uint64_t _start;
+
+    public:
+        explicit Scope(Phase phase) : _phase(phase), _start(now()) {}
+
+        ~Scope() { add(_phase, now() - _start); }
+    };
+
+/* \brief Charges consecutive sections of a function to their phases
+ *
+ * Each lap charges the time since the previous lap, or since construction,
+ * to the given phase, so one reading of the counter ends a section and
+ * starts the next. */
+    class Stopwatch {
+        uint64_t _last;
+
+    public:
+        Stopwatch() : _last(now()) {}
+
+        void lap(Phase phase) {
+            uint64_t current = now();
+            add(phase, current - _last);
+            _last = current;
+        }
+    };
+
+} /* namespace overhead */
+
+#endif /* __OVERHEAD_H__ */
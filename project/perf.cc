@@ -23,13 +23,16 @@ namespace perf {
 
     enum Events : uint64_t {
         Instructions = PERF_COUNT_HW_INSTRUCTIONS,
-        CacheMisses = PERF_COUNT_HW_CACHE_MISSES
+        CacheMisses = PERF_COUNT_HW_CACHE_MISSES,
+        Cycles = PERF_COUNT_HW_CPU_CYCLES,
+        RefCycles = PERF_COUNT_HW_REF_CPU_CYCLES     // at the nominal frequency, unaffected by frequency scaling
     };
 
-    static const std::map <uint64_t, std::string> EventNames __attribute__ ((init_priority(101))) = {{Events::Instructions, "Instructions"},
-                                                                                                     {Events::CacheMisses,  "Cache-Misses"}};
+    const char *const CounterNames[COUNTERS] = {"Instructions", "Cache-Misses", "Cycles", "Ref-Cycles"};
 
-    static const std::vector <uint64_t> EventList __attribute__ ((init_priority(101))) = {Events::Instructions, Events::CacheMisses};
+    // the perf event of each counter, in the order of Counter
+    static const std::vector <uint64_t> EventList __attribute__ ((init_priority(101))) = {Events::Instructions, Events::CacheMisses,
+                                                                                          Events::Cycles, Events::RefCycles};
 
 
     static std::optional <uint64_t> start_perf(uint64_t type, uint64_t event, int pid, int &group_fd) {
@@ -75,10 +78,11 @@ namespace perf {
         } values[];
     };
 
-    static std::optional <std::map<uint64_t, uint64_t>> perf_read(int fd) {
+    /* Reads the group of fd and adds the value of each event id that is in ids to its counter. */
+    static bool perf_read(int fd, const std::map <uint64_t, Counter> &ids, Values &values) {
         if (fd == -1) {
             LOGGER->debug("Perf not properly initialized for client\n");
-            return std::nullopt;
+            return false;
         }
 
         char buf[4096];
@@ -86,17 +90,20 @@ namespace perf {
 
         if (read(fd, buf, sizeof(buf)) == -1) {
             LOGGER->warning("Failed to read values from perf.\n");
-            return std::nullopt;
+            return false;
         }
 
-        /* Extract the data from perf */
-        std::map <uint64_t, uint64_t> data;
-
+        /* Extract the data from perf, the lookups do not allocate */
         for (uint64_t i = 0; i < formatted_buf->nr; ++i) {
-            data[formatted_buf->values[i].id] = formatted_buf->values[i].value;
+            auto it = ids.find(formatted_buf->values[i].id);
+            if (it == ids.end())
+                LOGGER->warning("Unknown event %llu occurred (value: %llu) on fd: %d\n", formatted_buf->values[i].id,
+                                formatted_buf->values[i].value, fd);
+            else
+                values[it->second] += formatted_buf->values[i].value;
         }
 
-        return data;
+        return true;
     }
 
 
@@ -126,10 +133,10 @@ namespace perf {
     class SinglePMUHandle : public Handle {
     private:
         int fd;
-        std::map <uint64_t, std::string> event_ids;
+        std::map <uint64_t, Counter> event_ids;
 
     public:
-        SinglePMUHandle(int fd, const std::map <uint64_t, std::string> &event_ids)
+        SinglePMUHandle(int fd, const std::map <uint64_t, Counter> &event_ids)
                 : fd{fd}, event_ids{event_ids} {
             if (!start(fd))
                 LOGGER->warning("Failed to start perf monitoring on fd: %d\n", fd);
@@ -146,19 +153,11 @@ namespace perf {
             close(fd);
         }
 
-        std::map <std::string, uint64_t> read() override {
-            std::map <std::string, uint64_t> result;
+        Values read() override {
+            Values result{};
 
-            if (auto raw_data = perf_read(fd)) {
-                for (auto &[id, val]: raw_data.value()) {
-                    if (!this->event_ids.contains(id))
-                        LOGGER->warning("Unknown event %llu occurred (value: %llu) on fd: %d\n", id, val, fd);
-                    else
-                        result[this->event_ids[id]] = val;
-                }
-            } else {
+            if (!perf_read(fd, event_ids, result))
                 LOGGER->warning("Reading perf values failed on fd: %d\n", fd);
-            }
 
             return result;
         }
@@ -168,14 +167,14 @@ namespace perf {
     public:
         HandlePtr new_process(int pid, const std::vector <uint64_t> &events) override {
             int perf_fd = -1;
-            std::map <uint64_t, std::string> event_ids;
+            std::map <uint64_t, Counter> event_ids;
 
-            for (auto event: events) {
-                if (auto id = start_perf(PERF_TYPE_HARDWARE, event, pid, perf_fd)) {
-                    event_ids.insert({id.value(), EventNames.at(event)});
+            for (size_t counter = 0; counter < events.size(); counter++) {
+                if (auto id = start_perf(PERF_TYPE_HARDWARE, events[counter], pid, perf_fd)) {
+                    event_ids.insert({id.value(), (Counter) counter});
                 } else {
                     LOGGER->warning("Failed to monitor perf event %s for client %d\n",
-                                    EventNames.at(event).c_str(), pid);
+                                    CounterNames[counter], pid);
                 }
             }
 
@@ -192,11 +191,11 @@ namespace perf {
 
     class MultiPMUHandle : public Handle {
     private:
-        std::vector <std::pair<int, std::map < uint64_t, std::string>>>
+        std::vector <std::pair<int, std::map < uint64_t, Counter>>>
         pmu_events;
 
     public:
-        MultiPMUHandle(const std::vector <std::pair<int, std::map < uint64_t, std::string>>
+        MultiPMUHandle(const std::vector <std::pair<int, std::map < uint64_t, Counter>>
 
         > &pmu_events)
         : pmu_events{ pmu_events } {
@@ -217,23 +216,14 @@ namespace perf {
             }
         }
 
-        std::map <std::string, uint64_t> read() override {
-            std::map <std::string, uint64_t> result;
+        Values read() override {
+            Values result{};
 
+            /* Each PMU has its own ids for the same events, perf_read sums the readings
+             * of the different PMUs into the counter of their type */
             for (auto &[fd, ids]: pmu_events) {
-                if (auto raw_data = perf_read(fd)) {
-                    auto data = raw_data.value();
-                    /* We get the raw reading from perf with id -> value. We now have to combine
-                     * reading from the different PMUs that are of the same type */
-                    for (const auto &[id, name]: ids) {
-                        if (!result.contains(name))
-                            result[name] = 0;
-                        if (!data.contains(id))
-                            LOGGER->warning("Missing value in perf results for %s on fd: %d\n", name.c_str(), fd);
-                        else
-                            result[name] += data[id];
-                    }
-                }
+                if (!perf_read(fd, ids, result))
+                    LOGGER->warning("Reading perf values failed on fd: %d\n", fd);
             }
 
             return result;
@@ -283,20 +273,20 @@ namespace perf {
         }
 
         HandlePtr new_process(int pid, const std::vector <uint64_t> &events) override {
-            std::vector < std::pair < int, std::map < uint64_t, std::string>>> pmu_events;
+            std::vector < std::pair < int, std::map < uint64_t, Counter>>> pmu_events;
             for (auto &pmu: pmus) {
                 int perf_fd = -1;
-                std::map <uint64_t, std::string> event_ids;
+                std::map <uint64_t, Counter> event_ids;
 
-                for (auto &event: events) {
-                    if (auto id = start_perf(PERF_TYPE_HARDWARE, pmu.perf_event_type(event), pid, perf_fd)) {
+                for (size_t counter = 0; counter < events.size(); counter++) {
+                    if (auto id = start_perf(PERF_TYPE_HARDWARE, pmu.perf_event_type(events[counter]), pid, perf_fd)) {
                         LOGGER->debug(" -> [%s] Registered event %s for client %d\n", pmu.name().c_str(),
-                                      EventNames.at(event).c_str(), pid);
+                                      CounterNames[counter], pid);
 
-                        event_ids.insert({id.value(), EventNames.at(event)});
+                        event_ids.insert({id.value(), (Counter) counter});
                     } else {
                         LOGGER->warning(" -> [%s] Failed to register event %s for client %d\n", pmu.name().c_str(),
-                                        EventNames.at(event).c_str(), pid);
+                                        CounterNames[counter], pid);
                     }
                 }
                 if (perf_fd != -1) {
@@ -316,13 +306,14 @@ namespace perf {
     };
 
 
-    PerfManager::PerfManager() : starter{nullptr} {
+    PerfManager::PerfManager(Topology topology) : starter{nullptr} {
         /*
          * Figure out if we are running on a heterogeneous system, because then we need a different perf starter type:
          * If there is only a /sys/devices/cpu/ directory in the sysfs, we have only one PMU, but if there are
          * multiple directories of the form /sys/devices/cpu_* in the sysfs, we have to simultaneously drive multiple PMUs.
+         * A forced MULTI also drives a single /sys/devices/cpu as a group of its own.
          */
-        if (fs::exists("/sys/devices/cpu")) {
+        if (topology == Topology::SINGLE || (topology == Topology::AUTO && fs::exists("/sys/devices/cpu"))) {
             starter = std::make_unique<SinglePMU>();
         } else {
             std::vector <fs::path> pmus;
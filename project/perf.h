@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <filesystem>
 #include <initializer_list>
 #include <map>
@@ -16,6 +18,20 @@
 
 namespace perf {
 
+    /* The events a handle counts, as positions in Values. */
+    enum Counter : size_t {
+        INSTRUCTIONS = 0,
+        CACHE_MISSES = 1,
+        CYCLES       = 2,
+        REF_CYCLES   = 3,
+        COUNTERS     = 4
+    };
+
+    extern const char *const CounterNames[COUNTERS];
+
+    /* One reading of a handle, an event that could not be opened stays 0. */
+    using Values = std::array<uint64_t, COUNTERS>;
+
     class Handle {
     protected:
         bool start(int fd);
@@ -25,7 +41,10 @@ namespace perf {
     public:
         virtual ~Handle() = default;
 
-        virtual std::map <std::string, uint64_t> read() = 0;
+        /* Current values of the events. Only reads the fds of the handle and does not
+         * allocate, so it fits the region boundaries, and several threads may read the
+         * same handle at once. */
+        virtual Values read() = 0;
     };
 
     using HandlePtr = std::unique_ptr<Handle>;
@@ -35,17 +54,25 @@ namespace perf {
     public:
         virtual ~Starter() = default;
 
+        /* Opens the perf events in the order of Counter. */
         virtual HandlePtr new_process(int pid, const std::vector <uint64_t> &events) = 0;
     };
 
     using StarterPtr = std::unique_ptr<Starter>;
 
+    /* Which kind of handle a PerfManager opens, AUTO picks the one that fits the PMUs in the sysfs. */
+    enum class Topology {
+        AUTO,
+        SINGLE,     // one PMU for all cores
+        MULTI       // one group per PMU, e.g. on hybrid cores, the values of the PMUs are summed
+    };
+
     class PerfManager {
     private:
         StarterPtr starter;
 
     public:
-        PerfManager();
+        explicit PerfManager(Topology topology = Topology::AUTO);
 
         std::optional <HandlePtr> open(int pid);
     };
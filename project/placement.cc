@@ -0,0 +1,203 @@
+#include "placement.h"
+#include "debug_util.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <tuple>
+
+#include <pthread.h>
+#include <sched.h>      // sched_getaffinity
+
+
+namespace placement {
+
+    const char *policy_name(Policy policy) {
+        switch (policy) {
+            case COMPACT:
+                return "compact";
+            case SPREAD:
+                return "spread";
+            default:
+                return "free";
+        }
+    }
+
+    std::string topology_root() {
+        const char *root = getenv("PLACEMENT_ROOT");
+        return root ? root : "/sys/devices/system/cpu";
+    }
+
+    static int read_id(const std::string &path) {
+        std::ifstream file(path);
+        int id = 0;
+        file >> id;
+        return id;
+    }
+
+    std::vector<Cpu> read_topology(const std::string &root, const std::vector<int> &cpus) {
+        std::vector<Cpu> topology;
+        for (int id: cpus) {
+            std::string dir = root + "/cpu" + std::to_string(id) + "/topology/";
+            topology.push_back({id, read_id(dir + "physical_package_id"), read_id(dir + "core_id")});
+        }
+        return topology;
+    }
+
+    std::vector<int> compact_order(std::vector<Cpu> cpus) {     // package by package, core by core, siblings next to each other
+        std::sort(cpus.begin(), cpus.end(), [](const Cpu &a, const Cpu &b) {
+            return std::tie(a.package, a.core, a.id) < std::tie(b.package, b.core, b.id);
+        });
+        std::vector<int> order;
+        for (auto &cpu: cpus) order.push_back(cpu.id);
+        return order;
+    }
+
+    std::vector<int> spread_order(const std::vector<Cpu> &cpus) {
+        /* the n-th sibling of each core is its round n, within a round the packages take turns */
+        std::map<std::pair<int, int>, int> siblings;    // (package, core) -> siblings seen so far
+        std::vector<std::tuple<int, int, int, int>> keys;   // round, position within the package, package, cpu
+        std::map<std::pair<int, int>, int> positions;   // (package, round) -> cpus of that round so far
+        for (auto &cpu: compact_order(cpus)) {
+            auto it = std::find_if(cpus.begin(), cpus.end(), [&](const Cpu &c) { return c.id == cpu; });
+            int round = siblings[{it->package, it->core}]++;
+            int position = positions[{it->package, round}]++;
+            keys.emplace_back(round, position, it->package, cpu);
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<int> order;
+        for (auto &key: keys) order.push_back(std::get<3>(key));
+        return order;
+    }
+
+    Controller::Controller(const std::vector<Cpu> &cpus, double threshold, unsigned int explore_every)
+            : _threshold{threshold}, _explore_every{explore_every} {
+        for (auto &cpu: cpus) _layouts[FREE].push_back(cpu.id);
+        _layouts[COMPACT] = compact_order(cpus);
+        _layouts[SPREAD] = spread_order(cpus);
+    }
+
+    std::unique_ptr<Controller> Controller::from_env() {
+        if (!getenv("PLACEMENT"))
+            return nullptr;
+
+        std::vector<int> cpus;
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+        if (cpus.empty()) {
+            LOGGER->warning("No cpus to place threads on, placement disabled\n");
+            return nullptr;
+        }
+
+        double threshold = getenv("PLACEMENT_MISS_RATIO") ? atof(getenv("PLACEMENT_MISS_RATIO")) : 0.01;
+        unsigned int explore_every = getenv("PLACEMENT_EXPLORE") ? atoi(getenv("PLACEMENT_EXPLORE")) : 10;
+
+        auto topology = read_topology(topology_root(), cpus);
+        LOGGER->info("Placement controller for %lu cpus\n", topology.size());
+        return std::make_unique<Controller>(topology, threshold, explore_every);
+    }
+
+    static double relative_cost(double cache_misses, double energy, double predicted_cache_misses,
+                                double predicted_energy) {    // 0 if there is nothing to compare to
+        if (energy > 0) return predicted_energy > 0 ? energy / predicted_energy : 0.0;
+        return predicted_cache_misses > 0 ? cache_misses / predicted_cache_misses : 0.0;   // without RAPL the cache misses stand in
+    }
+
+    Policy Controller::choose(const void *region, bool trained, const MissRatio &miss_ratio) {
+        std::lock_guard<std::mutex> guard(_lock);
+        Region &r = _regions[region];
+        if (!trained)
+            return FREE;
+
+        if (r.decided == FREE)
+            r.decided = miss_ratio() >= _threshold ? SPREAD : COMPACT;
+
+        bool explore = _explore_every > 0 && ++r.calls % _explore_every == 0;
+        return explore ? (r.decided == SPREAD ? COMPACT : SPREAD) : r.decided;
+    }
+
+    void Controller::feed(const void *region, Policy policy, double cache_misses, double energy,
+                          double predicted_cache_misses, double predicted_energy) {
+        std::lock_guard<std::mutex> guard(_lock);
+        Region &r = _regions[region];
+        Stats &stats = r.stats[policy];
+        stats.runs++;
+        stats.cache_misses += cache_misses;
+        stats.energy += energy;
+        double relative = relative_cost(cache_misses, energy, predicted_cache_misses, predicted_energy);
+        if (relative > 0) {
+            stats.relative_runs++;
+            stats.relative_cost += relative;
+        }
+
+        if (policy == r.decided || policy == FREE) return;
+
+        /* the opposite policy was explored, switch over if it did clearly better than predicted on average */
+        const Stats &decided = r.stats[r.decided];
+        if (stats.relative_runs < 2 || decided.relative_runs < 2) return;
+        double explored_cost = stats.relative_cost / stats.relative_runs;
+        double decided_cost = decided.relative_cost / decided.relative_runs;
+        if (explored_cost < 0.95 * decided_cost) {
+            LOGGER->info("Placement of a region switches from %s to %s\n", policy_name(r.decided), policy_name(policy));
+            r.decided = policy;
+            r.switches++;
+        }
+    }
+
+    /* pool threads keep their affinity between regions, so only changes cost a system call */
+    static thread_local int pinned_policy = -1;
+    static thread_local int pinned_thread = -1;
+
+    void Controller::pin(Policy policy, int thread_num) const {
+        if (pinned_policy == policy && pinned_thread == thread_num) return;
+
+        const std::vector<int> &layout = _layouts[policy];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (policy == FREE) {
+            for (int cpu: layout) CPU_SET(cpu, &set);
+        } else {
+            CPU_SET(layout[thread_num % layout.size()], &set);
+        }
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            LOGGER->warning("Failed to pin thread %d\n", thread_num);
+            return;
+        }
+        pinned_policy = policy;
+        pinned_thread = thread_num;
+    }
+
+    void Controller::forget_pin() const {
+        pinned_policy = -1;
+        pinned_thread = -1;
+    }
+
+    void Controller::report(std::ostream &out, const std::function<uint64_t(const void *)> &id) {
+        std::lock_guard<std::mutex> guard(_lock);
+        out << "Functions,Policy,Runs,Mean_Cache_Misses,Mean_Energy,Decided,Switches" << std::endl;
+        for (auto &[region, r]: _regions) {
+            for (Policy policy: {FREE, COMPACT, SPREAD}) {
+                const Stats &stats = r.stats[policy];
+                if (stats.runs == 0) continue;
+                out << id(region) << "," << policy_name(policy) << "," << stats.runs << ","
+                    << stats.cache_misses / stats.runs << "," << stats.energy / stats.runs << ","
+                    << (r.decided == policy) << "," << r.switches << std::endl;
+            }
+        }
+    }
+
+    SavedAffinity::SavedAffinity(const Controller &controller) : _controller{controller} {
+        _saved = pthread_getaffinity_np(pthread_self(), sizeof(_set), &_set) == 0;
+    }
+
+    SavedAffinity::~SavedAffinity() {
+        if (!_saved) return;
+        if (pthread_setaffinity_np(pthread_self(), sizeof(_set), &_set) != 0)
+            LOGGER->warning("Failed to restore the affinity of a thread\n");
+        _controller.forget_pin();
+    }
+
+} /* namespace placement */
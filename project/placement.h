@@ -0,0 +1,128 @@
+#ifndef __PLACEMENT_H__
+#define __PLACEMENT_H__
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <sched.h>      // cpu_set_t
+
+#include "MyAllocator.h"
+
+namespace placement {
+
+    enum Policy {
+        FREE    = 0,    // every thread may run on all cpus of the process
+        COMPACT = 1,    // threads on neighbouring cores, sharing caches
+        SPREAD  = 2     // threads across packages and cores, each with as much cache as possible
+    };
+
+    const char *policy_name(Policy policy);
+
+/* Root of the cpu topology in sysfs, PLACEMENT_ROOT or /sys/devices/system/cpu. */
+    std::string topology_root();
+
+    struct Cpu {
+        int id;
+        int package;    // physical_package_id
+        int core;       // core_id, unique within a package
+    };
+
+    /* Topology of the given cpus from <root>/cpuN/topology. */
+    std::vector<Cpu> read_topology(const std::string &root, const std::vector<int> &cpus);
+
+    /* Cpus in the order the threads of a team are put on them. */
+    std::vector<int> compact_order(std::vector<Cpu> cpus);
+
+    std::vector<int> spread_order(const std::vector<Cpu> &cpus);
+
+/* \brief Pins the team of each region compactly or spread out
+ *
+ * Trained regions are classified once from their predicted cache misses per
+ * instruction: memory-bound regions are spread, the others are compact. Every
+ * explore_every-th call runs with the opposite policy, and once that one
+ * measured less energy (or fewer cache misses if there is no energy
+ * measurement) than the chosen one, the region switches over. Calls of one
+ * region differ in their input, so the policies are compared by the measured
+ * cost relative to the predicted one, not by the raw means. Regions that are
+ * not trained run unpinned. */
+    class Controller {
+    public:
+        /* Predicted cache misses per instruction of the region, only asked for once per region. */
+        using MissRatio = std::function<double()>;
+
+    private:
+        struct Stats {
+            uint64_t runs = 0;
+            double cache_misses = 0.0;
+            double energy = 0.0;
+            uint64_t relative_runs = 0;     // runs with a prediction to compare to
+            double relative_cost = 0.0;     // sum of measured over predicted cost
+        };
+
+        struct Region {
+            Policy decided = FREE;
+            Stats stats[3];
+            uint64_t calls = 0;
+            uint64_t switches = 0;
+        };
+
+        std::vector<int> _layouts[3];   // cpu of each thread per policy, FREE holds all cpus
+        double _threshold;
+        unsigned int _explore_every;
+        std::mutex _lock;
+        InternalMap<const void *, Region> _regions;     // grows while regions run, so it lives in the arena
+
+    public:
+        Controller(const std::vector<Cpu> &cpus, double threshold, unsigned int explore_every);
+
+        /* Reads PLACEMENT, PLACEMENT_MISS_RATIO and PLACEMENT_EXPLORE for the cpus the process
+         * may run on, nullptr if PLACEMENT is not set. */
+        static std::unique_ptr<Controller> from_env();
+
+        /* Policy for the next call of the region. */
+        Policy choose(const void *region, bool trained, const MissRatio &miss_ratio);
+
+        /* Records the measured and predicted counters of a call that ran with the policy choose() gave it. */
+        void feed(const void *region, Policy policy, double cache_misses, double energy, double predicted_cache_misses,
+                  double predicted_energy);
+
+        /* Pins the calling thread, the thread_num-th of its team, according to the policy. */
+        void pin(Policy policy, int thread_num) const;
+
+        /* Unpins the calling thread, i.e. the next pin() sets its affinity again. */
+        void forget_pin() const;
+
+        /* One line per region and policy with the mean measured counters and the policy it ended up with. */
+        void report(std::ostream &out, const std::function<uint64_t(const void *)> &id);
+    };
+
+/* \brief The affinity of the calling thread, written back when it goes out of scope
+ *
+ * The first thread of a team is the one that started it, e.g. the program's
+ * main thread, which has to run with its own affinity again after the region. */
+    class SavedAffinity {
+        const Controller &_controller;
+        cpu_set_t _set;
+        bool _saved;
+
+    public:
+        explicit SavedAffinity(const Controller &controller);
+
+        ~SavedAffinity();
+
+        SavedAffinity(const SavedAffinity &) = delete;
+
+        SavedAffinity &operator=(const SavedAffinity &) = delete;
+    };
+
+} /* namespace placement */
+
+#endif /* __PLACEMENT_H__ */
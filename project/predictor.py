@@ -8,12 +8,16 @@ from sklearn.preprocessing import StandardScaler
 from sklearn.linear_model import LinearRegression
 from sklearn.pipeline import make_pipeline
 from sklearn.metrics import mean_squared_error
+from sklearn.multioutput import MultiOutputRegressor
+from sklearn.base import clone
+
+import numpy as np
 
 import warnings
 from sklearn.exceptions import ConvergenceWarning
 from scipy.linalg import LinAlgWarning
 
-def create(model_type, seed=42, poly_degree=2, poly_nnls=False):
+def create(model_type, seed=42, poly_degree=2, poly_nnls=False, n_outputs=1):
   # Model selection
   if model_type == "poly":
     model = make_pipeline(
@@ -41,6 +45,9 @@ def create(model_type, seed=42, poly_degree=2, poly_nnls=False):
     # Note: The default kernel is 'rbf' (Radial Basis Function), which is commonly used for non-linear data.
     # You may need to adjust the kernel, C, epsilon, and other parameters depending on your specific dataset.
     model = SVR(kernel="rbf", C=1e3, epsilon=0.1)
+    # SVR has no native multi-output support, so fit one SVR per output
+    if n_outputs > 1:
+      model = MultiOutputRegressor(model)
   else:
     raise ValueError("Unsupported model type. Choose 'poly', 'nn', 'gpr', or 'svm'.")
 
@@ -54,17 +61,56 @@ def fit(
     suppress_warnings : bool = True,
   ):
   # Training the model
+  train(model, input[-30:], output[-30:], suppress_warnings)
+
+def train(model, input, output, suppress_warnings : bool = True):
   if suppress_warnings:
     with warnings.catch_warnings():
       warnings.simplefilter("ignore", ConvergenceWarning)
       warnings.simplefilter("ignore", LinAlgWarning)
 
-      model.fit(input[-30:], output[-30:])
+      model.fit(input, output)
   else:
-    model.fit(input[-30:], output[-30:])
+    model.fit(input, output)
 
 def predict(model, x):
   return list(model.predict(x))
 
+def fit_window(model, x_buf, y_buf, rows, n_metrics, n_outputs):
+  # x_buf and y_buf are memoryviews on the ring buffers of predictor_py.h,
+  # numpy wraps them without copying. The window size is chosen on the C++ side,
+  # row order does not matter for fitting.
+  x = np.frombuffer(x_buf, dtype=np.float64).reshape(-1, n_metrics)[:rows]
+  y = np.frombuffer(y_buf, dtype=np.float64).reshape(-1, n_outputs)[:rows]
+  train(model, x, y if n_outputs > 1 else y.ravel())
+
+def warm_start(new_model, model):
+  # Continue from what the previous model learned instead of starting over.
+  # For gpr the optimized kernel becomes the starting point and the optimizer
+  # restarts, which dominate the fit time, are skipped.
+  if isinstance(new_model, GaussianProcessRegressor) and hasattr(model, "kernel_"):
+    new_model.set_params(kernel=model.kernel_, n_restarts_optimizer=0)
+
+def refit_window(initial_model, model, x_buf, y_buf, rows, n_metrics, n_outputs, full=True):
+  # Called from the training thread: fit an unfitted copy of the initial model,
+  # so the model in use can keep predicting until the new one is swapped in
+  new_model = clone(initial_model)
+  if not full:
+    warm_start(new_model, model)
+    try:
+      fit_window(new_model, x_buf, y_buf, rows, n_metrics, n_outputs)
+      return new_model
+    except (ValueError, np.linalg.LinAlgError):
+      # the previous hyperparameters do not fit the new window, start over
+      new_model = clone(initial_model)
+  fit_window(new_model, x_buf, y_buf, rows, n_metrics, n_outputs)
+  return new_model
+
+def predict_into(model, x_buf, out_buf, n_metrics, n_outputs):
+  # predict a single row and write one value per output into out_buf
+  x = np.frombuffer(x_buf, dtype=np.float64).reshape(1, n_metrics)
+  out = np.frombuffer(out_buf, dtype=np.float64)
+  out[:] = np.asarray(model.predict(x), dtype=np.float64).reshape(-1)[:n_outputs]
+
 if __name__ == "__main__":
     main()
@@ -3,8 +3,20 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include <cstdlib>
+#include <cstring>
+#include <cmath>
 #include <string>
 #include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "arena.h"
 
 namespace python {
 
@@ -19,6 +31,24 @@ namespace python {
         return obj;
     }
 
+/* Holds the GIL for the lifetime of the object. Every entry into python has to
+ * go through this, because the GIL is released right after initialization and
+ * is shared between the application threads and the training thread. */
+    class GIL {
+        PyGILState_STATE state;
+
+    public:
+        GIL() : state{PyGILState_Ensure()} {}
+
+        ~GIL() { PyGILState_Release(state); }
+
+        GIL(const GIL &) = delete;
+
+        GIL &operator=(const GIL &) = delete;
+    };
+
+    PyThreadState *main_thread_state = nullptr;
+
     void init() {
         // https://stackoverflow.com/questions/63406035/pyimport-import-cannot-find-module
         // include current directory in the PYTHONPATH - in order to find predictor.py
@@ -26,120 +56,478 @@ namespace python {
         setenv("PYTHONPATH", (".:" + pp).c_str(), 1);
 
         Py_Initialize();
+
+        // release the GIL, it is taken again only for the duration of each call into python
+        main_thread_state = PyEval_SaveThread();
     }
 
     void finalize(){
+        PyEval_RestoreThread(main_thread_state);
         if (Py_FinalizeEx() < 0) {
             fprintf(stderr,"Finalize failed\n");
             exit(1);
         }
     }
 
+    /* Number of samples each predictor keeps for training. predictor.py used to
+     * slice the last 30 rows out of ever-growing lists; the window is now held
+     * in a fixed ring buffer on the C++ side. Overridable via PYTHON_WINDOW. */
+    unsigned int window_size() {
+        const char *env = getenv("PYTHON_WINDOW");
+        int size = env ? atoi(env) : 0;
+        return size > 0 ? size : 30;
+    }
+
+    /* Training is done in the background unless PYTHON_ASYNC=0 is set. */
+    bool async_training() {
+        const char *env = getenv("PYTHON_ASYNC");
+        return !env || strcmp(env, "0") != 0;
+    }
+
+    /* When a model gets refit after a new sample arrived, set via REFIT_POLICY:
+     *   always     refit on every new sample (default)
+     *   every:N    refit once N new samples arrived
+     *   error:T    refit when the rolling relative prediction error exceeds T
+     *   budget:F   refit only while at most the fraction F of the wall time was spent fitting
+     * Every REFIT_FULL_EVERY-th refit (default 10) starts from scratch, the others are
+     * warm-started from the previous model (for gpr: its kernel, without optimizer restarts). */
+    struct RefitPolicy {
+        enum Kind {
+            ALWAYS,
+            EVERY,
+            ERROR,
+            BUDGET
+        } kind = ALWAYS;
+        uint64_t every = 1;
+        double error_threshold = 0.0;
+        double budget = 1.0;
+        uint64_t full_every = 10;
+
+        static RefitPolicy parse() {
+            RefitPolicy policy;
+
+            const char *env = getenv("REFIT_POLICY");
+            std::string spec = env ?: "always";
+            std::string kind = spec.substr(0, spec.find(':'));
+            double value = spec.find(':') != std::string::npos ? atof(spec.c_str() + spec.find(':') + 1) : 0.0;
+
+            if (kind == "every" && value >= 1) {
+                policy.kind = EVERY;
+                policy.every = (uint64_t) value;
+            } else if (kind == "error" && value > 0) {
+                policy.kind = ERROR;
+                policy.error_threshold = value;
+            } else if (kind == "budget" && value > 0) {
+                policy.kind = BUDGET;
+                policy.budget = value;
+            } else if (kind != "always") {
+                fprintf(stderr, "Unknown refit policy '%s', refitting on every sample\n", spec.c_str());
+            }
+
+            const char *full_env = getenv("REFIT_FULL_EVERY");
+            if (full_env && atoi(full_env) > 0) policy.full_every = atoi(full_env);
+
+            return policy;
+        }
+
+        static const RefitPolicy &get() {
+            static RefitPolicy policy = parse();
+            return policy;
+        }
+    };
+
+    class Predictor;
+
+    /* A single background thread that refits the models of all predictors. */
+    class Trainer {
+        std::mutex lock;
+        std::condition_variable wakeup;
+        std::deque<Predictor *> jobs;
+        bool running = false;
+
+        void loop();
+
+    public:
+        void submit(Predictor *predictor) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (!running) {
+                    running = true;
+                    // detached, so that a long running fit never blocks the application from exiting
+                    std::thread([this] { loop(); }).detach();
+                }
+                jobs.push_back(predictor);
+            }
+            wakeup.notify_one();
+        }
+
+        static Trainer &get() {
+            static Trainer *instance = new Trainer();
+            return *instance;
+        }
+    };
+
     class Predictor {
+        using clock = std::chrono::steady_clock;
+
         // python methods
         PyObject *create_py;
         PyObject *fit_py;
+        PyObject *refit_py;
         PyObject *predict_py;
-        // the actual scikit model
+        // the unfitted model as created, full refits start from it
+        PyObject *initial_pred;
+        // the actual scikit model which is used for predictions, replaced whenever a refit finished
         PyObject *pred;
-        // accumulated inputs
-        PyObject *list_x = PyList_New(0);
-        // accumulated expected outputs
-        PyObject *list_y = PyList_New(0);
+
+        unsigned int n_metrics;
+        unsigned int n_events;
+        unsigned int window;
+        bool async;
+        const RefitPolicy &policy = RefitPolicy::get();
+        // number of samples that were fed so far
+        uint64_t n_samples = 0;
+        // protects the ring buffer, the training flag and the counters against the training thread and the readers of the counters
+        mutable std::mutex ring_lock;
+
+        // ring buffer of inputs (window x n_metrics) and expected outputs (window x n_events)
+        std::vector<double> ring_x;
+        std::vector<double> ring_y;
+        // snapshot of the ring buffer the training thread works on, while the ring keeps filling
+        std::vector<double> train_x;
+        std::vector<double> train_y;
+        unsigned int train_rows = 0;
+        bool train_full = true;
+        uint64_t model_samples_pending = 0;
+        clock::rep model_time_pending = 0;
+        // set while the snapshot is handed to the training thread
+        bool training = false;
+
+        // refit bookkeeping for the policy and the fit time report
+        clock::time_point created = clock::now();
+        uint64_t refits = 0;
+        uint64_t full_refits = 0;
+        std::atomic<double> fit_seconds{0.0};
+        // exponentially weighted relative prediction error since the last refit
+        double rolling_error = 0.0;
+        unsigned int error_samples = 0;
+        bool predicted = false;
+        // single query row and the slot python writes the predictions to
+        std::vector<double> query_x;
+        std::vector<double> query_y;
+        // what the model in use predicted last, to track the prediction error
+        std::vector<double> last_prediction;
+
+        // memoryviews on the buffers above, python wraps them with numpy.frombuffer without copying
+        PyObject *view_x;
+        PyObject *view_y;
+        PyObject *view_train_x;
+        PyObject *view_train_y;
+        PyObject *view_query_x;
+        PyObject *view_query_y;
+
+        // age of the model in use: when and with how many samples its training data was taken
+        std::atomic<clock::rep> model_time;
+        std::atomic<uint64_t> model_samples{0};
+
+        static PyObject *view(std::vector<double> &buffer) {
+            return check_py(PyMemoryView_FromMemory(reinterpret_cast<char *>(buffer.data()),
+                                                    buffer.size() * sizeof(double), PyBUF_WRITE),
+                            "Failed to create memoryview");
+        }
+
+        /* Fits the model in use in place, the GIL has to be held. */
+        void call_fit(PyObject *x, PyObject *y, unsigned int rows) {
+            // python 'fit_window' gets the views and the number of valid rows in them
+            auto args = Py_BuildValue("(OOOIII)", pred, x, y, rows, n_metrics, n_events);
+            Py_DECREF(check_py(PyObject_CallObject(fit_py, args), "Call failed"));
+            Py_DECREF(args);
+        }
+
+        unsigned int rows() const {
+            return n_samples < window ? n_samples : window;
+        }
+
+        /* Copies the ring for the training thread and counts the refit, ring_lock has to be held. */
+        void snapshot() {
+            std::copy(ring_x.begin(), ring_x.end(), train_x.begin());
+            std::copy(ring_y.begin(), ring_y.end(), train_y.begin());
+            train_rows = rows();
+            train_full = refits % policy.full_every == 0;
+            refits++;
+            if (train_full) full_refits++;
+            model_samples_pending = n_samples;
+            model_time_pending = clock::now().time_since_epoch().count();
+            rolling_error = 0.0;
+            error_samples = 0;
+        }
+
+        /* Tracks how far off the last prediction was from the sample that was just added. */
+        void update_error(const double *outputs) {
+            if (!predicted) return;
+            predicted = false;
+
+            double error = 0.0;
+            for (unsigned int i = 0; i < n_events; i++)
+                error += fabs(last_prediction[i] - outputs[i]) / std::max(fabs(outputs[i]), 1.0);
+            error /= n_events;
+
+            rolling_error = error_samples == 0 ? error : 0.8 * rolling_error + 0.2 * error;
+            error_samples++;
+        }
+
+        /* Decides on a new refit, ring_lock has to be held. */
+        bool should_refit() {
+            if (n_samples <= model_samples_pending) return false;
+            // the model has not seen any real sample yet
+            if (model_samples_pending == 0) return true;
+
+            switch (policy.kind) {
+                case RefitPolicy::EVERY:
+                    return n_samples - model_samples_pending >= policy.every;
+                case RefitPolicy::ERROR:
+                    // a few predictions of the current model are needed before judging it
+                    return error_samples >= 3 && rolling_error > policy.error_threshold;
+                case RefitPolicy::BUDGET:
+                    return fit_seconds <= policy.budget *
+                                          std::chrono::duration<double>(clock::now() - created).count();
+                default:
+                    return true;
+            }
+        }
 
     public:
-        Predictor(const char *type, unsigned int size) {
+        Predictor(const char *type, unsigned int n_metrics, unsigned int n_events = 1,
+                  unsigned int window = window_size())
+                : n_metrics{n_metrics}, n_events{n_events}, window{window}, async{async_training()},
+                  ring_x(window * n_metrics, 0.0), ring_y(window * n_events, 0.0),
+                  train_x(window * n_metrics, 0.0), train_y(window * n_events, 0.0),
+                  query_x(n_metrics, 0.0), query_y(n_events, 0.0),
+                  last_prediction(n_events, 0.0), model_time{clock::now().time_since_epoch().count()} {
+            GIL gil;
+
             // importing predictor.py somewhere from the PYTHONPATH
             auto pModule = check_py(PyImport_ImportModule("predictor"), "Failed to load module");
 
             // loading the methods
             create_py  = check_py(PyObject_GetAttrString(pModule, "create"), "Failed to access 'create' method");
-            fit_py     = check_py(PyObject_GetAttrString(pModule, "fit"), "Failed to access 'fit' method");
-            predict_py = check_py(PyObject_GetAttrString(pModule, "predict"), "Failed to access 'predict' method");
+            fit_py     = check_py(PyObject_GetAttrString(pModule, "fit_window"), "Failed to access 'fit_window' method");
+            refit_py   = check_py(PyObject_GetAttrString(pModule, "refit_window"), "Failed to access 'refit_window' method");
+            predict_py = check_py(PyObject_GetAttrString(pModule, "predict_into"), "Failed to access 'predict_into' method");
             Py_DECREF(pModule);
 
-            auto args = PyTuple_New(1);
-            PyTuple_SetItem(args, 0, PyUnicode_FromString(type));
-            // call python 'create'
-            pred = check_py(PyObject_CallObject(create_py, args), "Call failed");
+            // call python 'create' for a model with one output per event
+            auto args = Py_BuildValue("(s)", type);
+            auto kwargs = Py_BuildValue("{s:I}", "n_outputs", n_events);
+            initial_pred = check_py(PyObject_Call(create_py, args, kwargs), "Call failed");
             Py_DECREF(args);
+            Py_DECREF(kwargs);
 
-            // initial call to fit to enable prediction
-            args = PyTuple_New(3);
-            Py_INCREF(pred);
-            PyTuple_SetItem(args, 0, pred);
-            auto empty_list = PyList_New(size);
-            for (unsigned int i = 0; i < size; i++)
-                PyList_SetItem(empty_list, i, Py_BuildValue("d", 0));
-            auto wrapper_list = PyList_New(1);
-            PyList_SetItem(wrapper_list, 0, empty_list);
-            PyTuple_SetItem(args, 1, wrapper_list);
-            PyTuple_SetItem(args, 2, Py_BuildValue("[i]", 0));
-            Py_DECREF(check_py(PyObject_CallObject(fit_py, args), "Call failed"));
-            Py_DECREF(args);
+            // the model in use has to be a separate object, fitting it must not touch the initial one
+            auto clone = check_py(PyImport_ImportModule("sklearn.base"), "Failed to load sklearn.base");
+            pred = check_py(PyObject_CallMethod(clone, "clone", "O", initial_pred), "Call failed");
+            Py_DECREF(clone);
+
+            view_x = view(ring_x);
+            view_y = view(ring_y);
+            view_train_x = view(train_x);
+            view_train_y = view(train_y);
+            view_query_x = view(query_x);
+            view_query_y = view(query_y);
+
+            // initial call to fit on a single zero row to enable prediction,
+            // the row is not counted and gets overwritten by the first sample
+            call_fit(view_x, view_y, 1);
         }
 
-        void fit(double *inputs, unsigned int size, double output) {
-            // the python fit method expects a 2d array of inputs and a 1d array of
-            // expected outputs: like [[1],[2],[3]], [1,4,9]
-            //
-            // However, the python fit method is not incremental thus multiple calls
-            // to this method are accumulated in the python lists 'list_x' and 'list_y'
+        Predictor(const Predictor &) = delete;
+
+        Predictor &operator=(const Predictor &) = delete;
 
-            auto args = PyTuple_New(3);
+        void fit(const double *inputs, const double *outputs) {
+            // the python fit method is not incremental, thus every sample is put into
+            // the ring buffer and the model is refit on the whole window
+            std::unique_lock<std::mutex> guard(ring_lock);
+            size_t row = n_samples % window;
+            std::copy(inputs, inputs + n_metrics, ring_x.begin() + row * n_metrics);
+            std::copy(outputs, outputs + n_events, ring_y.begin() + row * n_events);
+            n_samples++;
+            update_error(outputs);
 
-            auto element_x = PyList_New(size);
-            for (unsigned int i = 0; i < size; i++)
-                PyList_SetItem(element_x, i, Py_BuildValue("d", inputs[i]));
-            PyList_Append(list_x, element_x);
-            Py_DECREF(element_x);
+            request_refit(guard);
+        }
 
-            auto element_y = Py_BuildValue("d", output);
-            PyList_Append(list_y, element_y);
-            Py_DECREF(element_y);
+        /* Starts a refit if the policy asks for one, guard has to hold ring_lock and is released. */
+        void request_refit(std::unique_lock<std::mutex> &guard) {
+            // a refit is still running on an older snapshot, the training thread picks up the newest samples afterwards
+            if (training || !should_refit()) return;
 
-            Py_INCREF(pred);
-            Py_INCREF(list_x);
-            Py_INCREF(list_y);
-            PyTuple_SetItem(args, 0, pred);
-            PyTuple_SetItem(args, 1, list_x);
-            PyTuple_SetItem(args, 2, list_y);
+            snapshot();
+            training = true;
+            guard.unlock();
 
-            // call python 'fit'
-            auto fit_ret = check_py(PyObject_CallObject(fit_py, args), "Call failed");
-            Py_DECREF(args);
-            Py_DECREF(fit_ret);
+            if (async) Trainer::get().submit(this);
+            else train();
         }
 
-        double predict(double *inputs, unsigned int size) {
-            auto args = PyTuple_New(2);
+        /* The training window as a flat array: number of rows, inputs, expected outputs, the rows oldest first. */
+        std::vector<double> save_window() {
+            std::lock_guard<std::mutex> guard(ring_lock);
+            unsigned int n = rows();
+            size_t head = n_samples > window ? n_samples % window : 0;    // the oldest row once the ring wrapped
+            std::vector<double> state;
+            state.reserve(1 + n * (n_metrics + n_events));
+            state.push_back(n);
+            for (unsigned int i = 0; i < n; i++) {
+                size_t row = (head + i) % window;
+                state.insert(state.end(), ring_x.begin() + row * n_metrics, ring_x.begin() + (row + 1) * n_metrics);
+            }
+            for (unsigned int i = 0; i < n; i++) {
+                size_t row = (head + i) % window;
+                state.insert(state.end(), ring_y.begin() + row * n_events, ring_y.begin() + (row + 1) * n_events);
+            }
+            return state;
+        }
 
-            auto list_x_outer = PyList_New(1);
+        /* Refills the training window from save_window() output, e.g. of a previous run, and refits on it.
+         * A saved window larger than this one gives up its oldest rows. */
+        bool restore_window(const double *state, size_t size) {
+            if (size < 1) return false;
+            unsigned int saved = (unsigned int) state[0];
+            unsigned int n = std::min(saved, window);
+            if (size < 1 + (size_t) saved * (n_metrics + n_events)) return false;
 
-            auto list_x = PyList_New(size);
-            for (unsigned int i = 0; i < size; i++)
-                PyList_SetItem(list_x, i, Py_BuildValue("d", inputs[i]));
-            PyList_SetItem(list_x_outer, 0, list_x);
+            std::unique_lock<std::mutex> guard(ring_lock);
+            const double *x = state + 1 + (size_t) (saved - n) * n_metrics;     // the newest n rows
+            const double *y = state + 1 + (size_t) saved * n_metrics + (size_t) (saved - n) * n_events;
+            std::copy(x, x + n * n_metrics, ring_x.begin());
+            std::copy(y, y + n * n_events, ring_y.begin());
+            n_samples = n;
 
-            Py_INCREF(pred);
-            PyTuple_SetItem(args, 0, pred);
-            PyTuple_SetItem(args, 1, list_x_outer);
+            request_refit(guard);
+            return true;
+        }
 
-            // call python 'predict'
-            auto prediction = check_py(PyObject_CallObject(predict_py, args), "Call failed");
-            Py_DECREF(args);
-            return PyFloat_AsDouble(PyList_GetItem(prediction, 0));
+        /* Called from the training thread: fits a fresh model on the snapshot and swaps it in. */
+        void train() {
+            auto start = clock::now();
+            {
+                GIL gil;
+
+                auto args = Py_BuildValue("(OOOOIIIO)", initial_pred, pred, view_train_x, view_train_y, train_rows,
+                                          n_metrics, n_events, train_full ? Py_True : Py_False);
+                PyObject *new_pred = PyObject_CallObject(refit_py, args);
+                Py_DECREF(args);
+
+                if (new_pred) {
+                    // predictions hold their own reference, so the old model can be released right away.
+                    // Both sides hold the GIL here, which makes the swap atomic.
+                    PyObject *old_pred = pred;
+                    pred = new_pred;
+                    Py_DECREF(old_pred);
+
+                    model_samples = model_samples_pending;
+                    model_time = model_time_pending;
+                } else {
+                    // keep predicting with the previous model
+                    PyErr_Print();
+                }
+            }
+
+            fit_seconds = fit_seconds + std::chrono::duration<double>(clock::now() - start).count();
+
+            // samples that arrived during the refit are trained on right away
+            std::unique_lock<std::mutex> guard(ring_lock);
+            if (async && should_refit()) {
+                snapshot();
+                guard.unlock();
+                Trainer::get().submit(this);
+            } else {
+                training = false;
+            }
+        }
+
+        void predict(const double *inputs, double *outputs) {
+            std::copy(inputs, inputs + n_metrics, query_x.begin());
+
+            {
+                GIL gil;
+
+                // call python 'predict_into', which writes one value per event into the query_y view
+                Py_INCREF(pred);
+                auto args = Py_BuildValue("(NOOII)", pred, view_query_x, view_query_y, n_metrics, n_events);
+                Py_DECREF(check_py(PyObject_CallObject(predict_py, args), "Call failed"));
+                Py_DECREF(args);
+            }
+
+            std::copy(query_y.begin(), query_y.end(), outputs);
+
+            std::lock_guard<std::mutex> guard(ring_lock);
+            std::copy(query_y.begin(), query_y.end(), last_prediction.begin());
+            predicted = true;
+        }
+
+        /* Seconds since the training data of the model in use was taken. */
+        double model_age() const {
+            return std::chrono::duration<double>(clock::now().time_since_epoch() -
+                                                 clock::duration(model_time.load())).count();
+        }
+
+        /* Number of samples that arrived after the training data of the model in use was taken. */
+        uint64_t samples_behind() const {
+            std::lock_guard<std::mutex> guard(ring_lock);
+            return n_samples - model_samples;
         }
 
+        uint64_t samples() const {
+            std::lock_guard<std::mutex> guard(ring_lock);
+            return n_samples;
+        }
+
+        uint64_t refit_count() const {
+            std::lock_guard<std::mutex> guard(ring_lock);
+            return refits;
+        }
+
+        uint64_t full_refit_count() const {
+            std::lock_guard<std::mutex> guard(ring_lock);
+            return full_refits;
+        }
+
+        /* Total wall time spent in refits of this predictor. */
+        double fit_time() const { return fit_seconds; }
+
         ~Predictor() {
+            GIL gil;
+
             Py_DECREF(create_py);
             Py_DECREF(fit_py);
+            Py_DECREF(refit_py);
             Py_DECREF(predict_py);
+            Py_DECREF(initial_pred);
             Py_DECREF(pred);
-            Py_DECREF(list_x);
-            Py_DECREF(list_y);
+            Py_DECREF(view_x);
+            Py_DECREF(view_y);
+            Py_DECREF(view_train_x);
+            Py_DECREF(view_train_y);
+            Py_DECREF(view_query_x);
+            Py_DECREF(view_query_y);
         }
 
     };
 
-} // end namespace python
\ No newline at end of file
+    void Trainer::loop() {
+        arena::Scope internal;      // the fits allocate for my_omp.so, not for the program
+        while (true) {
+            Predictor *predictor;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wakeup.wait(guard, [this] { return !jobs.empty(); });
+                predictor = jobs.front();
+                jobs.pop_front();
+            }
+            predictor->train();
+        }
+    }
+
+} // end namespace python
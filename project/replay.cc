@@ -0,0 +1,585 @@
+#include <stdio.h>
+#include <unistd.h>     // getopt
+
+#include <algorithm>
+#include <charconv>     // to_chars
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "debug_util.h"
+
+/* graybox-replay: replays a recorded run offline. The metrics of every call
+ * come from progress.csv, the measurements from measurements/NN.csv, and
+ * each region's models see them in the same predict-then-feed order as
+ * my_omp.so did online. Regions are independent, so every region and
+ * predictor configuration is replayed on a core of its own, all
+ * configurations in the same pass. Only the per-region models are replayed,
+ * like a run with GLOBAL_BLEND=0 and without FEATURE_PRUNE.
+ *
+ * For each configuration the output directory gets a directory with the
+ * layout of csvs (progress.csv, measurements, predictions and errors.csv),
+ * so the evaluation scripts run on it unchanged.
+ *
+ * With -s the configurations are llsp with every pair of a grid of aging
+ * factors and column contributions instead, and only the errors are kept:
+ * sweep.csv gets the errors of every pair, and the best pair of each region
+ * and of all regions together is printed as the environment of my_omp.so.
+ *
+ * Usage: graybox-replay [-p llsp,mean,last | -s aging,...:contribution,... [-e event,...]] [-o replay]
+ *                       [-t trace.bin] <csvs directory or trace.bin> */
+
+namespace fs = std::filesystem;
+
+extern "C" {
+
+typedef struct llsp_s llsp_t;
+
+struct llsp_params {
+    double aging;
+    double contribution;
+};
+
+struct llsp_params llsp_default_params(void);
+
+llsp_t *llsp_new_ex(size_t count, const struct llsp_params *params);
+
+void llsp_add(llsp_t *llsp, const double *metrics, double target);
+
+const double *llsp_solve(llsp_t *llsp);
+
+double llsp_predict(llsp_t *llsp, const double *metrics);
+
+void llsp_dispose(llsp_t *llsp);
+
+}
+
+#define TRACE_MAGIC 0x54524247u     // "GBRT"
+#define TRACE_VERSION 1
+
+const char *const EVENT_HEADER = "Cache_Misses,Energy,Instructions,Duration,Cycles,Ref_Cycles,";
+const std::vector<std::string> EVENT_NAMES = {"Cache-Misses", "Energy", "Instructions", "Duration", "Cycles",
+                                              "Ref-Cycles"};
+
+/* \brief The calls of a recorded run, in the order they started */
+struct Trace {
+    uint32_t metrics = 0;
+    uint32_t events = 0;
+    std::vector<uint32_t> functions;    // function id of each call
+    std::vector<double> inputs;         // calls x metrics
+    std::vector<double> measured;       // calls x events
+};
+
+/* \brief Calls of one function, indices into the trace */
+struct Region {
+    uint32_t function;
+    std::vector<size_t> calls;
+};
+
+/* \brief One event's predictor of one region */
+class Model {
+public:
+    virtual ~Model() = default;
+
+    virtual double predict(const double *metrics) = 0;
+
+    virtual void feed(const double *metrics, double target) = 0;
+};
+
+class LlspModel : public Model {
+    llsp_t *_llsp;
+
+public:
+    LlspModel(size_t metrics, const llsp_params &params) : _llsp(llsp_new_ex(metrics, &params)) {}
+
+    ~LlspModel() override { llsp_dispose(_llsp); }
+
+    double predict(const double *metrics) override { return llsp_predict(_llsp, metrics); }
+
+    void feed(const double *metrics, double target) override {
+        llsp_add(_llsp, metrics, target);
+        llsp_solve(_llsp);
+    }
+};
+
+class MeanModel : public Model {    // baseline: the mean of all measurements so far
+    double _sum = 0.0;
+    uint64_t _count = 0;
+
+public:
+    double predict(const double *) override { return _count ? _sum / _count : 0.0; }
+
+    void feed(const double *, double target) override {
+        _sum += target;
+        _count++;
+    }
+};
+
+class LastModel : public Model {    // baseline: the previous measurement
+    double _last = 0.0;
+
+public:
+    double predict(const double *) override { return _last; }
+
+    void feed(const double *, double target) override { _last = target; }
+};
+
+struct Config {
+    std::string name;
+    std::function<std::unique_ptr<Model>(size_t metrics)> create;
+    llsp_params params{};     // only for the llsp configurations
+};
+
+Config llsp_config(const std::string &name, llsp_params params) {
+    return {name, [params](size_t metrics) { return std::make_unique<LlspModel>(metrics, params); }, params};
+}
+
+std::vector<Config> available_configs() {
+    return {
+            llsp_config("llsp", llsp_default_params()),
+            {"mean", [](size_t) { return std::make_unique<MeanModel>(); }},
+            {"last", [](size_t) { return std::make_unique<LastModel>(); }},
+    };
+}
+
+/* Same statistics as csvs/errors.csv of my_omp.so. */
+struct Errors {
+    uint64_t samples = 0;
+    double absolute = 0.0;
+    double relative = 0.0;
+    uint64_t relative_samples = 0;
+    double max_relative = 0.0;
+
+    void add(double predicted, double measured) {
+        double error = std::fabs(predicted - measured);
+        samples++;
+        absolute += error;
+        if (measured != 0) {
+            relative += error / std::fabs(measured);
+            relative_samples++;
+            max_relative = std::max(max_relative, error / std::fabs(measured));
+        }
+    }
+};
+
+/* Replayed predictions of one region with one configuration. */
+struct Result {
+    std::vector<double> predicted;      // calls of the region x events
+    std::vector<Errors> errors;         // per event
+};
+
+std::string function_file(uint32_t function) {     // same names as create_csvs of my_omp.so
+    std::string name = std::to_string(function);
+    if (function < 10) name.insert(0, "0");
+    return name + ".csv";
+}
+
+/* Parses the comma separated numbers of a line into values, returns how many there were. */
+size_t parse_line(const std::string &line, std::vector<double> &values) {
+    values.clear();
+    const char *p = line.c_str();
+    while (*p) {
+        char *end;
+        double value = strtod(p, &end);
+        if (end == p) break;
+        values.push_back(value);
+        p = end;
+        if (*p == ',') p++;
+    }
+    return values.size();
+}
+
+bool read_csvs(const fs::path &dir, Trace &trace) {
+    std::ifstream progress(dir / "progress.csv");
+    if (!progress.is_open()) {
+        LOGGER->error("Failed to open %s\n", (dir / "progress.csv").c_str());
+        return false;
+    }
+    std::string line;
+    std::getline(progress, line);      // Functions,Metrics,,,
+    trace.metrics = std::count(line.begin(), line.end(), ',');
+    trace.events = EVENT_NAMES.size();
+
+    std::map<uint32_t, std::vector<double>> measurements;      // rows of each function, one after the other
+    std::map<uint32_t, size_t> used;
+    std::vector<double> values;
+    while (std::getline(progress, line)) {
+        if (parse_line(line, values) != trace.metrics + 1) continue;    // cut off by the end of the run
+        auto function = (uint32_t) values[0];
+
+        if (!measurements.contains(function)) {
+            std::ifstream file(dir / "measurements" / function_file(function));
+            std::string row;
+            std::vector<double> events;
+            std::getline(file, row);    // header
+            auto &rows = measurements[function];
+            while (std::getline(file, row))
+                if (parse_line(row, events) == trace.events) rows.insert(rows.end(), events.begin(), events.end());
+        }
+
+        size_t index = used[function]++;
+        if ((index + 1) * trace.events > measurements[function].size()) continue;  // the call never ended
+        trace.functions.push_back(function);
+        trace.inputs.insert(trace.inputs.end(), values.begin() + 1, values.end());
+        trace.measured.insert(trace.measured.end(), measurements[function].begin() + index * trace.events,
+                              measurements[function].begin() + (index + 1) * trace.events);
+    }
+    return true;
+}
+
+bool read_trace(const fs::path &path, Trace &trace) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        LOGGER->error("Failed to open %s\n", path.c_str());
+        return false;
+    }
+    uint32_t header[4];
+    uint64_t calls = 0;
+    bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == TRACE_MAGIC &&
+              header[1] == TRACE_VERSION && fread(&calls, sizeof(calls), 1, file) == 1;
+    if (ok) {
+        trace.metrics = header[2];
+        trace.events = header[3];
+        trace.functions.resize(calls);
+        trace.inputs.resize(calls * trace.metrics);
+        trace.measured.resize(calls * trace.events);
+        ok = fread(trace.functions.data(), sizeof(uint32_t), calls, file) == calls &&
+             fread(trace.inputs.data(), sizeof(double), trace.inputs.size(), file) == trace.inputs.size() &&
+             fread(trace.measured.data(), sizeof(double), trace.measured.size(), file) == trace.measured.size();
+    }
+    fclose(file);
+    if (!ok) LOGGER->error("%s is not a graybox-replay trace\n", path.c_str());
+    return ok;
+}
+
+bool write_trace(const fs::path &path, const Trace &trace) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        LOGGER->error("Failed to create %s\n", path.c_str());
+        return false;
+    }
+    uint32_t header[4] = {TRACE_MAGIC, TRACE_VERSION, trace.metrics, trace.events};
+    uint64_t calls = trace.functions.size();
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(&calls, sizeof(calls), 1, file) == 1 &&
+              fwrite(trace.functions.data(), sizeof(uint32_t), calls, file) == calls &&
+              fwrite(trace.inputs.data(), sizeof(double), trace.inputs.size(), file) == trace.inputs.size() &&
+              fwrite(trace.measured.data(), sizeof(double), trace.measured.size(), file) == trace.measured.size();
+    ok &= fclose(file) == 0;
+    if (!ok) LOGGER->error("Failed to write %s\n", path.c_str());
+    return ok;
+}
+
+/* Without keep, only the errors are collected, a sweep would not fit the predictions of all its pairs in memory. */
+Result replay(const Trace &trace, const Region &region, const Config &config, bool keep) {
+    std::vector<std::unique_ptr<Model>> models;
+    for (uint32_t e = 0; e < trace.events; e++) models.push_back(config.create(trace.metrics));
+
+    Result result;
+    if (keep) result.predicted.resize(region.calls.size() * trace.events);
+    result.errors.resize(trace.events);
+    for (size_t c = 0; c < region.calls.size(); c++) {
+        const double *metrics = &trace.inputs[region.calls[c] * trace.metrics];
+        const double *measured = &trace.measured[region.calls[c] * trace.events];
+        for (uint32_t e = 0; e < trace.events; e++) {
+            double predicted = models[e]->predict(metrics);     // as predict_and_start_perf
+            if (keep) result.predicted[c * trace.events + e] = predicted;
+            result.errors[e].add(predicted, measured[e]);
+            models[e]->feed(metrics, measured[e]);              // as end_perf_and_feed_predictor
+        }
+    }
+    return result;
+}
+
+/* Shortest text that reads back as the same double, much faster than an ostream. */
+void append(std::string &text, double value) {
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    text.append(buffer, end);
+}
+
+void write_file(const fs::path &path, const std::string &text) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file || fwrite(text.data(), 1, text.size(), file) != text.size())
+        LOGGER->error("Failed to write %s\n", path.c_str());
+    if (file) fclose(file);
+}
+
+/* Rows of events in the format of the measurement and prediction files, with the trailing comma. */
+void write_rows(const fs::path &path, const std::vector<double> &values, size_t columns) {
+    std::string text = std::string(EVENT_HEADER) + "\n";
+    for (size_t i = 0; i < values.size(); i += columns) {
+        for (size_t c = 0; c < columns; c++) {
+            append(text, values[i + c]);
+            text += ',';
+        }
+        text += '\n';
+    }
+    write_file(path, text);
+}
+
+/* One directory in the layout of csvs for the configuration. The inputs are the same for all configurations,
+ * so they are written once and copied into the directories of the others. */
+void write_config(const fs::path &dir, const fs::path &inputs, const Trace &trace, const std::vector<Region> &regions,
+                  const std::vector<Result> &results) {
+    fs::create_directories(dir / "predictions");
+    if (inputs.empty()) {
+        fs::create_directories(dir / "measurements");
+        std::string progress = "Functions,Metrics" + std::string(trace.metrics - 1, ',') + "\n";
+        for (size_t c = 0; c < trace.functions.size(); c++) {
+            progress += std::to_string(trace.functions[c]);
+            for (uint32_t m = 0; m < trace.metrics; m++) {
+                progress += ',';
+                append(progress, trace.inputs[c * trace.metrics + m]);
+            }
+            progress += '\n';
+        }
+        write_file(dir / "progress.csv", progress);
+    } else {
+        fs::copy(inputs / "progress.csv", dir / "progress.csv", fs::copy_options::overwrite_existing);
+        fs::copy(inputs / "measurements", dir / "measurements",
+                 fs::copy_options::overwrite_existing | fs::copy_options::recursive);
+    }
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t r = 0; r < regions.size(); r++) {
+        if (inputs.empty()) {
+            std::vector<double> measured;
+            for (size_t call: regions[r].calls)
+                measured.insert(measured.end(), trace.measured.begin() + call * trace.events,
+                                trace.measured.begin() + (call + 1) * trace.events);
+            write_rows(dir / "measurements" / function_file(regions[r].function), measured, trace.events);
+        }
+        write_rows(dir / "predictions" / function_file(regions[r].function), results[r].predicted, trace.events);
+    }
+
+    std::ofstream errors(dir / "errors.csv");
+    errors << "Functions,Event,Samples,Mean_Absolute_Error,Mean_Relative_Error,Max_Relative_Error" << std::endl;
+    for (size_t r = 0; r < regions.size(); r++) {
+        for (uint32_t e = 0; e < trace.events; e++) {
+            const Errors &error = results[r].errors[e];
+            errors << regions[r].function << "," << EVENT_NAMES[e] << "," << error.samples << ","
+                   << (error.samples ? error.absolute / error.samples : 0.0) << ","
+                   << (error.relative_samples ? error.relative / error.relative_samples : 0.0) << ","
+                   << error.max_relative << '\n';
+        }
+    }
+}
+
+std::vector<std::string> split(const std::string &list, char separator = ',') {
+    std::vector<std::string> items;
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, separator))
+        if (!item.empty()) items.push_back(item);
+    return items;
+}
+
+/* One llsp configuration per pair of "aging,...:contribution,...". */
+bool grid_configs(const std::string &grid, std::vector<Config> &configs) {
+    size_t colon = grid.find(':');
+    if (colon == std::string::npos) return false;
+    auto agings = split(grid.substr(0, colon)), contributions = split(grid.substr(colon + 1));
+    for (auto &aging: agings) {
+        for (auto &contribution: contributions) {
+            llsp_params params{strtod(aging.c_str(), nullptr), strtod(contribution.c_str(), nullptr)};
+            configs.push_back(llsp_config("llsp-a" + aging + "-c" + contribution, params));
+        }
+    }
+    return !configs.empty();
+}
+
+/* Function id -> stable key from the regions.csv of a csvs directory, empty for a trace. */
+std::map<uint32_t, std::string> read_keys(const fs::path &input) {
+    std::map<uint32_t, std::string> keys;
+    std::ifstream file(input / "regions.csv");
+    std::string line;
+    std::getline(file, line);      // Functions,Key
+    while (std::getline(file, line)) {
+        size_t comma = line.find(',');
+        if (comma != std::string::npos && comma + 1 < line.size())
+            keys[(uint32_t) strtoul(line.c_str(), nullptr, 10)] = line.substr(comma + 1);
+    }
+    return keys;
+}
+
+/* The score a sweep minimizes: the mean over the chosen events of their mean relative error. */
+double score(const std::vector<Result> &results, const std::vector<bool> &chosen) {
+    double sum = 0.0;
+    int events = 0;
+    for (size_t e = 0; e < chosen.size(); e++) {
+        if (!chosen[e]) continue;
+        double relative = 0.0;
+        uint64_t samples = 0;
+        for (auto &result: results) {
+            relative += result.errors[e].relative;
+            samples += result.errors[e].relative_samples;
+        }
+        if (samples == 0) continue;     // e.g. Energy without RAPL
+        sum += relative / samples;
+        events++;
+    }
+    return events ? sum / events : INFINITY;
+}
+
+/* Writes sweep.csv and prints the best pair of each region and of all regions. */
+void report_sweep(const fs::path &out, const std::vector<Config> &configs, const std::vector<Region> &regions,
+                  const std::vector<std::vector<Result>> &results, const std::vector<bool> &chosen,
+                  const std::map<uint32_t, std::string> &keys) {
+    fs::create_directories(out);
+    std::ofstream sweep(out / "sweep.csv");
+    sweep << "Aging,Contribution,Functions,Event,Samples,Mean_Relative_Error,Max_Relative_Error" << std::endl;
+    for (size_t c = 0; c < configs.size(); c++) {
+        for (size_t r = 0; r < regions.size(); r++) {
+            for (size_t e = 0; e < EVENT_NAMES.size(); e++) {
+                const Errors &error = results[c][r].errors[e];
+                sweep << configs[c].params.aging << "," << configs[c].params.contribution << ","
+                      << regions[r].function << "," << EVENT_NAMES[e] << "," << error.samples << ","
+                      << (error.relative_samples ? error.relative / error.relative_samples : 0.0) << ","
+                      << error.max_relative << '\n';
+            }
+        }
+    }
+
+    std::vector<double> overall(configs.size());
+    for (size_t c = 0; c < configs.size(); c++) overall[c] = score(results[c], chosen);
+    size_t best = std::min_element(overall.begin(), overall.end()) - overall.begin();
+    const llsp_params defaults = llsp_default_params();
+
+    printf("%-8s %10s %13s %13s %13s\n", "Region", "Aging", "Contribution", "Best score", "Global score");
+    std::string overrides;
+    for (size_t r = 0; r < regions.size(); r++) {
+        std::vector<double> scores(configs.size());
+        for (size_t c = 0; c < configs.size(); c++) scores[c] = score({results[c][r]}, chosen);
+        size_t own = std::min_element(scores.begin(), scores.end()) - scores.begin();
+        printf("%-8u %10g %13g %13.4f %13.4f\n", regions[r].function, configs[own].params.aging,
+               configs[own].params.contribution, scores[own], scores[best]);
+        if (scores[own] < scores[best]) {   // only regions the global pair does not serve best need an override
+            auto key = keys.find(regions[r].function);
+            char pair[64];
+            snprintf(pair, sizeof(pair), "=%g:%g", configs[own].params.aging, configs[own].params.contribution);
+            overrides += (overrides.empty() ? "" : ",") +
+                         (key != keys.end() ? key->second : std::to_string(regions[r].function)) + pair;
+        }
+    }
+    printf("%-8s %10g %13g %13.4f   (defaults %g and %g)\n", "all", configs[best].params.aging,
+           configs[best].params.contribution, overall[best], defaults.aging, defaults.contribution);
+    printf("\nLLSP_AGING=%g LLSP_CONTRIBUTION=%g", configs[best].params.aging, configs[best].params.contribution);
+    if (!overrides.empty()) printf(" LLSP_PARAMS=\"%s\"", overrides.c_str());
+    printf("\n");
+}
+
+void usage() {
+    fprintf(stderr, "usage: graybox-replay [-p llsp,mean,last | -s aging,...:contribution,... [-e event,...]] "
+                    "[-o replay] [-t trace.bin] <csvs directory or trace.bin>\n");
+}
+
+int main(int argc, char **argv) {
+    std::string config_list = "llsp,mean,last";
+    fs::path out = "replay";
+    fs::path trace_out;
+    std::string grid, event_list;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:s:e:o:t:h")) != -1) {
+        switch (opt) {
+            case 'p': config_list = optarg; break;
+            case 's': grid = optarg; break;
+            case 'e': event_list = optarg; break;
+            case 'o': out = optarg; break;
+            case 't': trace_out = optarg; break;
+            default: usage(); return 1;
+        }
+    }
+    fs::path input = optind < argc ? argv[optind] : "csvs";
+
+    std::vector<Config> configs;
+    if (!grid.empty() && !grid_configs(grid, configs)) {
+        LOGGER->error("The grid %s is not of the form aging,...:contribution,...\n", grid.c_str());
+        return 1;
+    }
+    std::vector<bool> chosen(EVENT_NAMES.size(), event_list.empty());   // events the sweep scores, default all
+    for (auto &name: split(event_list)) {
+        auto it = std::find(EVENT_NAMES.begin(), EVENT_NAMES.end(), name);
+        if (it == EVENT_NAMES.end()) {
+            LOGGER->error("Unknown event %s\n", name.c_str());
+            return 1;
+        }
+        chosen[it - EVENT_NAMES.begin()] = true;
+    }
+    for (auto &name: grid.empty() ? split(config_list) : std::vector<std::string>()) {
+        auto available = available_configs();
+        auto it = std::find_if(available.begin(), available.end(), [&](const Config &c) { return c.name == name; });
+        if (it == available.end()) {
+            LOGGER->error("Unknown predictor configuration %s\n", name.c_str());
+            return 1;
+        }
+        configs.push_back(*it);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Trace trace;
+    if (!(fs::is_directory(input) ? read_csvs(input, trace) : read_trace(input, trace))) return 1;
+    if (trace.metrics == 0 || trace.events != EVENT_NAMES.size()) {
+        LOGGER->error("The trace has %u metrics and %u events, expected %zu events\n", trace.metrics, trace.events,
+                      EVENT_NAMES.size());
+        return 1;
+    }
+    if (!trace_out.empty() && !write_trace(trace_out, trace)) return 1;
+    std::chrono::duration<double> loaded = std::chrono::steady_clock::now() - start;
+
+    std::vector<Region> regions;
+    std::map<uint32_t, size_t> region_index;
+    for (size_t c = 0; c < trace.functions.size(); c++) {
+        auto [it, added] = region_index.try_emplace(trace.functions[c], regions.size());
+        if (added) regions.push_back({trace.functions[c], {}});
+        regions[it->second].calls.push_back(c);
+    }
+
+    // every region with every configuration is a task of its own, the longest regions first
+    std::vector<std::pair<size_t, size_t>> tasks;
+    for (size_t r = 0; r < regions.size(); r++)
+        for (size_t c = 0; c < configs.size(); c++) tasks.emplace_back(r, c);
+    std::sort(tasks.begin(), tasks.end(), [&](auto &a, auto &b) {
+        return regions[a.first].calls.size() > regions[b.first].calls.size();
+    });
+    std::vector<std::vector<Result>> results(configs.size(), std::vector<Result>(regions.size()));
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t t = 0; t < tasks.size(); t++)
+        results[tasks[t].second][tasks[t].first] = replay(trace, regions[tasks[t].first], configs[tasks[t].second],
+                                                          grid.empty());
+    std::chrono::duration<double> replayed = std::chrono::steady_clock::now() - start;
+
+    printf("%zu calls of %zu regions, %u metrics, loaded in %.3fs, replayed in %.3fs\n", trace.functions.size(),
+           regions.size(), trace.metrics, loaded.count(), replayed.count() - loaded.count());
+    if (!grid.empty()) {
+        auto keys = fs::is_directory(input) ? read_keys(input) : std::map<uint32_t, std::string>();
+        report_sweep(out, configs, regions, results, chosen, keys);
+        return 0;
+    }
+    printf("%-12s", "Config");
+    for (auto &name: EVENT_NAMES) printf(" %13s", name.c_str());
+    printf("   (mean relative error over all calls)\n");
+    for (size_t c = 0; c < configs.size(); c++) {
+        write_config(out / configs[c].name, c ? out / configs[0].name : fs::path(), trace, regions, results[c]);
+        printf("%-12s", configs[c].name.c_str());
+        for (uint32_t e = 0; e < trace.events; e++) {
+            double relative = 0.0;
+            uint64_t samples = 0;
+            for (auto &result: results[c]) {
+                relative += result.errors[e].relative;
+                samples += result.errors[e].relative_samples;
+            }
+            printf(" %13.4f", samples ? relative / samples : 0.0);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+"""
+Sweeps the synthetic kernels of build/synthetic under my_omp.so and compares the predictions with the measurements
+and with the closed-form work and traffic of each call.
+
+Usage: python3 run_synthetic.py [--kernels stream,fma,...] [--threads 1,2,4] [--reps 5] [--predictor llsp]
+
+Every kernel runs in a temporary directory, so the csvs directory of the project is left alone. The csvs of each run
+are kept in results/synthetic/<kernel>, and one summary over all kernels is written to results/synthetic/summary.csv.
+"""
+import argparse
+import csv
+import os
+import shutil
+import subprocess
+import tempfile
+
+KERNELS = ['stream', 'fma', 'chase', 'cache', 'imbalance', 'alloc']
+EVENTS = ['Cache_Misses', 'Energy', 'Instructions', 'Duration', 'Cycles', 'Ref_Cycles']
+CACHE_LINE = 64
+
+# events whose scaling follows from the ground truth of synthetic.csv, and the column that is its law
+LAWS = {'Instructions': lambda call: call['Work'], 'Cache_Misses': lambda call: call['Bytes'] / CACHE_LINE}
+
+
+def read_rows(file_path):
+    """
+    Reads a csv into a list of dictionaries, numbers as floats. The trailing comma of the measurement files is dropped.
+
+    :param file_path: Path to the CSV file.
+    :return: List of rows.
+    """
+    rows = []
+    with open(file_path, mode='r') as file:
+        reader = csv.reader(file)
+        header = [column for column in next(reader) if column]
+        for row in reader:
+            values = {}
+            for column, value in zip(header, row):
+                try:
+                    values[column] = float(value)
+                except ValueError:
+                    values[column] = value
+            rows.append(values)
+    return rows
+
+
+def run_kernel(kernel, threads, reps, predictor, directory):
+    """
+    Runs one kernel in the given directory, which gets a fresh csvs directory.
+
+    :return: False if the run failed.
+    """
+    os.makedirs(os.path.join(directory, 'csvs/measurements'))
+    os.makedirs(os.path.join(directory, 'csvs/predictions'))
+    python_path = os.pathsep.join(path for path in [os.getcwd(), os.environ.get('PYTHONPATH')] if path)  # predictor.py
+    env = dict(os.environ, LD_PRELOAD=os.path.abspath('./build/my_omp.so'), PREDICTOR=predictor, PYTHONPATH=python_path)
+    result = subprocess.run([os.path.abspath('./build/synthetic'), kernel, '--threads', threads, '--reps', str(reps)],
+                            env=env, cwd=directory, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return result.returncode == 0
+
+
+def align_calls(csvs):
+    """
+    Pairs every call of synthetic.csv with the measurement and the prediction of its region, by the order in
+    progress.csv. Every call of a kernel is exactly one parallel region.
+
+    :param csvs: The csvs directory of the run.
+    :return: List of (call, function, measured, predicted).
+    """
+    calls = read_rows(os.path.join(csvs, 'synthetic.csv'))
+    order = [int(row['Functions']) for row in read_rows(os.path.join(csvs, 'progress.csv'))]
+    if len(order) != len(calls):
+        raise RuntimeError(f'{len(calls)} calls but {len(order)} regions, was the run complete?')
+
+    measurements, predictions, seen = {}, {}, {}
+    aligned = []
+    for call, function in zip(calls, order):
+        if function not in measurements:
+            measurements[function] = read_rows(os.path.join(csvs, f'measurements/{function:02d}.csv'))
+            predictions[function] = read_rows(os.path.join(csvs, f'predictions/{function:02d}.csv'))
+        index = seen.get(function, 0)
+        seen[function] = index + 1
+        aligned.append((call, function, measurements[function][index], predictions[function][index]))
+    return aligned
+
+
+def mean_relative_error(pairs):
+    """
+    :param pairs: List of (estimate, measured).
+    :return: Mean of |estimate - measured| / |measured| over the measurements that are not 0, None if there are none.
+    """
+    errors = [abs(estimate - measured) / abs(measured) for estimate, measured in pairs if measured != 0]
+    return sum(errors) / len(errors) if errors else None
+
+
+def fit_law(pairs):
+    """
+    Least squares fit of measured = a + b * law.
+
+    :param pairs: List of (law, measured).
+    :return: The fitted values in the same order and the coefficient of determination.
+    """
+    n = len(pairs)
+    mean_x = sum(x for x, _ in pairs) / n
+    mean_y = sum(y for _, y in pairs) / n
+    sxx = sum((x - mean_x) ** 2 for x, _ in pairs)
+    sxy = sum((x - mean_x) * (y - mean_y) for x, y in pairs)
+    slope = sxy / sxx if sxx else 0.0
+    fitted = [mean_y + slope * (x - mean_x) for x, _ in pairs]
+    ss_res = sum((y - f) ** 2 for (_, y), f in zip(pairs, fitted))
+    ss_tot = sum((y - mean_y) ** 2 for _, y in pairs)
+    return fitted, (1 - ss_res / ss_tot) if ss_tot else None
+
+
+def overhead_percent(functions, csvs):
+    """
+    :return: Overhead of my_omp.so in percent of the run time of the given functions, from overhead.csv in csvs.
+    """
+    overhead, region_time = 0.0, 0.0
+    for row in read_rows(os.path.join(csvs, 'overhead.csv')):
+        if row['Functions'] in functions:
+            overhead += row['Overhead']
+            region_time += row['Region_Time']
+    return 100 * overhead / region_time if region_time else None
+
+
+def evaluate(kernel, warmup, csvs):
+    """
+    Compares predictions and measurements of all calls after the first warmup ones.
+
+    :param csvs: The csvs directory of the run.
+    :return: One summary row per event.
+    """
+    aligned = align_calls(csvs)[warmup:]
+    functions = {function for _, function, _, _ in aligned}
+    overhead = overhead_percent(functions, csvs)
+
+    rows = []
+    for event in EVENTS:
+        row = {'Kernel': kernel, 'Event': event, 'Calls': len(aligned),
+               'Predictor_Error': mean_relative_error([(p[event], m[event]) for _, _, m, p in aligned]),
+               'Law_Error': None, 'Law_R2': None, 'Overhead_Percent': overhead}
+        if event in LAWS and len(aligned) > 1:     # the error a model that knows the scaling law would make
+            pairs = [(LAWS[event](call), m[event]) for call, _, m, _ in aligned]
+            fitted, r2 = fit_law(pairs)
+            row['Law_Error'] = mean_relative_error([(f, y) for f, (_, y) in zip(fitted, pairs)])
+            row['Law_R2'] = r2
+        rows.append(row)
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Sweeps the synthetic kernels under my_omp.so')
+    parser.add_argument('--kernels', default=','.join(KERNELS))
+    parser.add_argument('--threads', default=str(os.cpu_count()))
+    parser.add_argument('--reps', type=int, default=5)
+    parser.add_argument('--predictor', default='llsp')
+    args = parser.parse_args()
+
+    kernels = [kernel for kernel in args.kernels.split(',') if kernel]
+    if not os.path.exists('./build/synthetic') or not os.path.exists('./build/my_omp.so'):
+        print('build/synthetic or build/my_omp.so is missing, run make first')
+        return 1
+
+    summary = []
+    for kernel in kernels:
+        print(f'Running {kernel}')
+        with tempfile.TemporaryDirectory(prefix=f'synthetic-{kernel}-') as directory:
+            if not run_kernel(kernel, args.threads, args.reps, args.predictor, directory):
+                print(f'{kernel} failed, skipping it')
+                continue
+            csvs = os.path.join(directory, 'csvs')
+            calls = len(read_rows(os.path.join(csvs, 'synthetic.csv')))
+            summary += evaluate(kernel, calls // args.reps if args.reps > 1 else 0, csvs)    # the first repetition trains
+            target = f'results/synthetic/{kernel}'
+            shutil.rmtree(target, ignore_errors=True)
+            shutil.copytree(csvs, target)
+
+    os.makedirs('results/synthetic', exist_ok=True)
+    columns = ['Kernel', 'Event', 'Calls', 'Predictor_Error', 'Law_Error', 'Law_R2', 'Overhead_Percent']
+    with open('results/synthetic/summary.csv', mode='w', newline='') as file:
+        writer = csv.DictWriter(file, fieldnames=columns)
+        writer.writeheader()
+        writer.writerows(summary)
+
+    print(f'{"Kernel":<10} {"Event":<13} {"Pred. err":>10} {"Law err":>10} {"Law R2":>8} {"Overhead %":>11}')
+    for row in summary:
+        cells = [row[column] for column in columns[3:]]
+        print(f'{row["Kernel"]:<10} {row["Event"]:<13} ' + ' '.join(
+            f'{cell:>{width}.3f}' if cell is not None else f'{"-":>{width}}' for cell, width in zip(cells, [10, 10, 8, 11])))
+    return 0
+
+
+if __name__ == '__main__':
+    exit(main())
@@ -0,0 +1,192 @@
+#include "schedule_tuner.h"
+#include "debug_util.h"
+#include "string_util.h"
+
+#include <algorithm>
+#include <limits>
+
+
+extern "C" {
+
+llsp_t *llsp_new(size_t count);
+
+void llsp_add(llsp_t *llsp, const double *metrics, double target);
+
+const double *llsp_solve(llsp_t *llsp);
+
+double llsp_predict(llsp_t *llsp, const double *metrics);
+
+void llsp_dispose(llsp_t *llsp);
+
+}
+
+#define TUNER_METRICS 2     // bias and trip count
+
+namespace schedule_tuner {
+
+    const char *Config::parallel_symbol() const {
+        switch (kind) {
+            case STATIC:
+                return "GOMP_parallel_loop_static";
+            case DYNAMIC:
+                return "GOMP_parallel_loop_dynamic";
+            case GUIDED:
+                return "GOMP_parallel_loop_guided";
+            default:
+                return nullptr;
+        }
+    }
+
+    const char *Config::start_symbol() const {
+        switch (kind) {
+            case STATIC:
+                return "GOMP_loop_static_start";
+            case DYNAMIC:
+                return "GOMP_loop_dynamic_start";
+            case GUIDED:
+                return "GOMP_loop_guided_start";
+            default:
+                return nullptr;
+        }
+    }
+
+    std::string Config::name() const {
+        switch (kind) {
+            case STATIC:
+                return "static";
+            case DYNAMIC:
+                return "dynamic";
+            case GUIDED:
+                return "guided";
+            default:
+                return "runtime";
+        }
+    }
+
+    ScheduleTuner::ScheduleTuner(governor::Objective objective, std::vector<long> chunks, unsigned int trials,
+                                 unsigned int explore_every)
+            : _objective{objective}, _trials{std::max(trials, 1u)}, _explore_every{explore_every} {
+        _configs.push_back({RUNTIME, 0});
+        _configs.push_back({STATIC, 0});    // one block per thread
+        for (long chunk: chunks) {
+            for (Kind kind: {STATIC, DYNAMIC, GUIDED})
+                _configs.push_back({kind, chunk});
+        }
+    }
+
+    ScheduleTuner::~ScheduleTuner() {
+        for (auto &[fn, region]: _regions) {
+            for (auto &state: region.configs) {
+                llsp_dispose(state.time);
+                llsp_dispose(state.energy);
+            }
+        }
+    }
+
+    std::unique_ptr<ScheduleTuner> ScheduleTuner::from_env() {
+        const char *name = getenv("SCHEDULE_TUNER");
+        if (!name)
+            return nullptr;
+
+        governor::Objective objective;
+        if (!governor::parse_objective(name, objective)) {
+            LOGGER->error("Unknown SCHEDULE_TUNER %s, expected time, energy or edp\n", name);
+            return nullptr;
+        }
+
+        std::vector<long> chunks;
+        for (auto &value: string_util::split(getenv("SCHEDULE_CHUNKS") ? getenv("SCHEDULE_CHUNKS") : "1,16,64", ',')) {
+            long chunk = atol(value.c_str());
+            if (chunk > 0) chunks.push_back(chunk);
+        }
+
+        unsigned int trials = getenv("SCHEDULE_TRIALS") ? atoi(getenv("SCHEDULE_TRIALS")) : 3;
+        unsigned int explore_every = getenv("SCHEDULE_EXPLORE") ? atoi(getenv("SCHEDULE_EXPLORE")) : 20;
+
+        auto tuner = std::make_unique<ScheduleTuner>(objective, std::move(chunks), trials, explore_every);
+        LOGGER->info("Schedule tuner for %s with %lu configurations\n", name, tuner->_configs.size());
+        return tuner;
+    }
+
+    ScheduleTuner::Region &ScheduleTuner::region(const void *fn) {
+        Region &r = _regions[fn];
+        if (r.configs.empty()) {
+            r.configs.resize(_configs.size());
+            for (auto &state: r.configs) {
+                state.time = llsp_new(TUNER_METRICS);
+                state.energy = llsp_new(TUNER_METRICS);
+            }
+        }
+        return r;
+    }
+
+    size_t ScheduleTuner::choose(const void *fn, long trip_count) {
+        std::lock_guard<std::mutex> guard(_lock);
+        auto it = _regions.find(fn);
+        if (it == _regions.end())
+            return 0;   // not known to have a schedule(runtime) loop
+        Region &r = it->second;
+        uint64_t call = r.calls++;
+        if (trip_count == 0)
+            trip_count = r.last_trip_count;
+
+        for (size_t i = 0; i < r.configs.size(); i++)
+            if (r.configs[i].runs < _trials) return i;  // every configuration gets its trials first
+
+        if (_explore_every > 0 && call % _explore_every == 0) {
+            size_t explore = r.next_explore;
+            r.next_explore = (r.next_explore + 1) % r.configs.size();
+            return explore;
+        }
+
+        double metrics[TUNER_METRICS] = {1.0, (double) trip_count};
+        size_t best = 0;
+        double best_score = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < r.configs.size(); i++) {
+            governor::Cost cost{llsp_predict(r.configs[i].time, metrics), llsp_predict(r.configs[i].energy, metrics)};
+            double s = governor::score(_objective, cost);
+            if (s < best_score) {
+                best = i;
+                best_score = s;
+            }
+        }
+        r.configs[best].chosen++;
+        return best;
+    }
+
+    void ScheduleTuner::feed(const void *fn, size_t config, long trip_count, const governor::Cost &cost) {
+        std::lock_guard<std::mutex> guard(_lock);
+        Region &r = region(fn);
+        r.last_trip_count = trip_count;
+        State &state = r.configs[config];
+        double metrics[TUNER_METRICS] = {1.0, (double) trip_count};
+        llsp_add(state.time, metrics, cost.time);
+        llsp_solve(state.time);
+        llsp_add(state.energy, metrics, cost.energy);
+        llsp_solve(state.energy);
+        state.runs++;
+        state.time_sum += cost.time;
+        state.energy_sum += cost.energy;
+    }
+
+    void ScheduleTuner::report(std::ostream &out, const std::function<uint64_t(const void *)> &id) {
+        std::lock_guard<std::mutex> guard(_lock);
+        out << "Functions,Schedule,Chunk,Runs,Chosen,Mean_Time,Mean_Energy,Gain" << std::endl;
+        for (auto &[fn, r]: _regions) {
+            auto mean = [&](const State &state) {
+                return governor::Cost{state.time_sum / state.runs, state.energy_sum / state.runs};
+            };
+            double baseline = r.configs[RUNTIME].runs ? governor::score(_objective, mean(r.configs[RUNTIME])) : 0.0;
+            for (size_t i = 0; i < r.configs.size(); i++) {
+                const State &state = r.configs[i];
+                if (state.runs == 0) continue;
+                governor::Cost cost = mean(state);
+                double s = governor::score(_objective, cost);
+                double gain = s > 0 ? baseline / s : 0.0;   // > 1 means better than the program's schedule
+                out << id(fn) << "," << _configs[i].name() << "," << _configs[i].chunk << "," << state.runs << ","
+                    << state.chosen << "," << cost.time << "," << cost.energy << "," << gain << std::endl;
+            }
+        }
+    }
+
+} /* namespace schedule_tuner */
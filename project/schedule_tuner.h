@@ -0,0 +1,107 @@
+#ifndef __SCHEDULE_TUNER_H__
+#define __SCHEDULE_TUNER_H__
+
+#pragma once
+
+#include "governor.h"
+#include "MyAllocator.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+typedef struct llsp_s llsp_t;
+
+namespace schedule_tuner {
+
+    enum Kind {
+        RUNTIME = 0,    // whatever schedule(runtime) resolves to, the program's own choice
+        STATIC  = 1,
+        DYNAMIC = 2,
+        GUIDED  = 3
+    };
+
+    struct Config {
+        Kind kind;
+        long chunk;     // 0 for the default chunk of the kind
+
+        /* Name of the libgomp entry point that starts a parallel region with a loop with this schedule,
+         * nullptr for RUNTIME. */
+        const char *parallel_symbol() const;
+
+        /* Name of the libgomp entry point that starts a loop inside a region with this schedule,
+         * nullptr for RUNTIME. */
+        const char *start_symbol() const;
+
+        std::string name() const;
+    };
+
+/* \brief Picks the schedule and chunk size of schedule(runtime) loops per region
+ *
+ * Every region first runs each configuration a few times, then keeps one
+ * llsp model per configuration for time and energy over the trip count. The
+ * configuration with the best predicted objective is used from then on,
+ * except that every explore_every-th call runs the next configuration in turn
+ * to keep the models of the others current. Configuration 0 is always the
+ * schedule the program would have used, it is the baseline of the report.
+ * Regions are only tuned once a call was fed, i.e. once they were seen to
+ * run a schedule(runtime) loop. */
+    class ScheduleTuner {
+    private:
+        struct State {
+            llsp_t *time;
+            llsp_t *energy;
+            uint64_t runs = 0;
+            uint64_t chosen = 0;    // times the models picked this configuration
+            double time_sum = 0.0;
+            double energy_sum = 0.0;
+        };
+
+        struct Region {
+            InternalVector<State> configs;
+            uint64_t calls = 0;
+            size_t next_explore = 0;
+            long last_trip_count = 0;
+        };
+
+        governor::Objective _objective;
+        std::vector<Config> _configs;
+        unsigned int _trials;
+        unsigned int _explore_every;
+        std::mutex _lock;
+        InternalMap<const void *, Region> _regions;     // grows while regions run, so it lives in the arena
+
+        Region &region(const void *fn);     // _lock must be held
+
+    public:
+        ScheduleTuner(governor::Objective objective, std::vector<long> chunks, unsigned int trials,
+                      unsigned int explore_every);
+
+        ~ScheduleTuner();
+
+        /* Reads SCHEDULE_TUNER (time, energy or edp), SCHEDULE_CHUNKS, SCHEDULE_TRIALS and
+         * SCHEDULE_EXPLORE, nullptr if SCHEDULE_TUNER is not set. */
+        static std::unique_ptr<ScheduleTuner> from_env();
+
+        const Config &config(size_t index) const { return _configs[index]; }
+
+        /* Index of the configuration the next call of the region runs with, 0 if the region was not
+         * fed yet. A trip count of 0 means unknown, the one of the last call is used then. */
+        size_t choose(const void *fn, long trip_count);
+
+        /* Records the measured time in seconds and energy of a call. */
+        void feed(const void *fn, size_t config, long trip_count, const governor::Cost &cost);
+
+        /* One line per region and configuration with the mean measured cost, how often the models
+         * chose it and its gain over the program's schedule. */
+        void report(std::ostream &out, const std::function<uint64_t(const void *)> &id);
+    };
+
+} /* namespace schedule_tuner */
+
+#endif /* __SCHEDULE_TUNER_H__ */
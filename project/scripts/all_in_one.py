@@ -32,22 +32,30 @@ predictions = {func: pd.read_csv(os.path.join(predictions_dir, func + '.csv')) f
 # Ensure we have the same set of functions for measurements and predictions
 functions = measurement_functions.intersection(prediction_functions)
 
+# List of metrics
+metrics = ['Cache_Misses', 'Energy', 'Instructions', 'Duration', 'Cycles', 'Ref_Cycles']
+
 # Create empty lists to store the aligned measurements, predictions, and errors
-aligned_measurements = {'Cache_Misses': [], 'Energy': [], 'Instructions': []}
-aligned_predictions = {'Cache_Misses': [], 'Energy': [], 'Instructions': []}
-errors = {'Cache_Misses': [], 'Energy': [], 'Instructions': []}
+aligned_measurements = {metric: [] for metric in metrics}
+aligned_predictions = {metric: [] for metric in metrics}
+errors = {metric: [] for metric in metrics}
 
 def format_function_name(func):
     return f'{int(func):02d}'
 
+# Index of the next measurement and prediction of each function, so that no rows have to be dropped
+next_row = {func: 0 for func in functions}
+
 # Iterate through the execution order and extract the corresponding measurements and predictions
 for func in execution_order['Functions']:
     formatted_func = format_function_name(func)  # Format function name with leading zeros
-    if formatted_func in functions:
+    if formatted_func in functions and next_row[formatted_func] < min(len(measurements[formatted_func]), len(predictions[formatted_func])):
+        row = next_row[formatted_func]
+        next_row[formatted_func] += 1
         # Get the next measurement for this function
-        func_measurements = measurements[formatted_func].iloc[0]
+        func_measurements = measurements[formatted_func].iloc[row]
         # Get the next prediction for this function
-        func_predictions = predictions[formatted_func].iloc[0]
+        func_predictions = predictions[formatted_func].iloc[row]
 
         # Append the values to the aligned lists
         for metric in aligned_measurements.keys():
@@ -57,15 +65,8 @@ for func in execution_order['Functions']:
             error = abs(func_measurements[metric] - func_predictions[metric])
             errors[metric].append(error)
 
-        # Remove the used measurement and prediction
-        measurements[formatted_func] = measurements[formatted_func].iloc[1:].reset_index(drop=True)
-        predictions[formatted_func] = predictions[formatted_func].iloc[1:].reset_index(drop=True)
-
 # Create a figure with vertical subplots for the scatter plots
-fig, axs = plt.subplots(nrows=3, ncols=1, figsize=(10, 18), sharex=True)
-
-# List of metrics
-metrics = ['Cache_Misses', 'Energy', 'Instructions']
+fig, axs = plt.subplots(nrows=len(metrics), ncols=1, figsize=(10, 6 * len(metrics)), sharex=True)
 
 # Plot each metric in a separate subplot for scatter plot
 for i, metric in enumerate(metrics):
@@ -88,7 +89,7 @@ plt.tight_layout()
 plt.savefig("plots/all_in_one.png")
 
 # Now create a separate figure for the box plots of errors
-fig, axs = plt.subplots(nrows=1, ncols=3, figsize=(18, 6))
+fig, axs = plt.subplots(nrows=1, ncols=len(metrics), figsize=(6 * len(metrics), 6))
 
 # Plot each metric in a separate subplot for box plots of absolute errors without outliers
 for i, metric in enumerate(metrics):
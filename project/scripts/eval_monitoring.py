@@ -6,13 +6,13 @@ file_path = 'csvs/monitoring.csv'  # Path to the CSV file
 data = pd.read_csv(file_path)
 
 # Ensure that the columns are correctly named
-assert 'Cache_Misses' in data.columns and 'Energy' in data.columns and 'Instructions' in data.columns, "The CSV file must contain the columns Cache_Misses, Energy, and Instructions."
+assert all(column in data.columns for column in ['Cache_Misses', 'Cycles', 'Energy', 'Instructions', 'Ref_Cycles']), "The CSV file must contain the columns Cache_Misses, Cycles, Energy, Instructions and Ref_Cycles."
 
 # Create a time axis (x-axis)
 time = range(len(data))
 
 # Create a figure with multiple subplots
-fig, axs = plt.subplots(3, 1, figsize=(10, 15))
+fig, axs = plt.subplots(5, 1, figsize=(10, 25))
 
 # Function to plot a specific subplot
 def plot_column(ax, column_name, color):
@@ -32,6 +32,12 @@ plot_column(axs[1], 'Energy', 'orange')
 # Plot for the Instructions
 plot_column(axs[2], 'Instructions', 'green')
 
+# Plot for the Cycles
+plot_column(axs[3], 'Cycles', 'cyan')
+
+# Plot for the Ref_Cycles
+plot_column(axs[4], 'Ref_Cycles', 'olive')
+
 # Adjust layout and save the figure
 plt.tight_layout()
 plt.savefig('./plots/monitoring_all_plots.png')
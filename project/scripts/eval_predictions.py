@@ -11,8 +11,10 @@ def plot_columns(file1, file2, count, save_prefix='scatter_plot'):
     # Ensure both files have the same structure
     assert all(data1.columns == data2.columns), "Both CSV files must have the same column structure"
 
-    # Ensure columns Cache_Misses, Energy, and Instructions are present
-    assert 'Cache_Misses' in data1.columns and 'Energy' in data1.columns and 'Instructions' in data1.columns, "CSV files must contain columns Cache_Misses, Energy, and Instructions"
+    # Ensure columns Cache_Misses, Energy, Instructions, Duration, Cycles and Ref_Cycles are present
+    columns = [('Cache_Misses', 'blue', 'red'), ('Energy', 'orange', 'purple'), ('Instructions', 'green', 'brown'),
+               ('Duration', 'black', 'gray'), ('Cycles', 'cyan', 'magenta'), ('Ref_Cycles', 'olive', 'pink')]
+    assert all(column in data1.columns for column, _, _ in columns), "CSV files must contain columns Cache_Misses, Energy, Instructions, Duration, Cycles and Ref_Cycles"
 
     # Plotting function for a single column using scatter plot
     def scatter_single_column(ax, x1, y1, x2, y2, label1, label2, color1, color2):
@@ -24,23 +26,16 @@ def plot_columns(file1, file2, count, save_prefix='scatter_plot'):
         ax.grid(True)
 
     # Create subplots for each column
-    fig, axs = plt.subplots(3, 1, figsize=(10, 15))
+    fig, axs = plt.subplots(len(columns), 1, figsize=(10, 5 * len(columns)))
 
     # Time axis (x-axis)
     time1 = range(len(data1))
     time2 = range(len(data2))
 
-    # Scatter plot for column Cache_Misses
-    scatter_single_column(axs[0], time1, data1['Cache_Misses'], time2, data2['Cache_Misses'], 'Cache_Misses from File 1', 'Cache_Misses from File 2', 'blue', 'red')
-    axs[0].set_title('Column Cache_Misses Comparison')
-
-    # Scatter plot for column Energy
-    scatter_single_column(axs[1], time1, data1['Energy'], time2, data2['Energy'], 'Energy from File 1', 'Energy from File 2', 'orange', 'purple')
-    axs[1].set_title('Column Energy Comparison')
-
-    # Scatter plot for column Instructions
-    scatter_single_column(axs[2], time1, data1['Instructions'], time2, data2['Instructions'], 'Instructions from File 1', 'Instructions from File 2', 'green', 'brown')
-    axs[2].set_title('Column Instructions Comparison')
+    # Scatter plot for each column
+    for ax, (column, color1, color2) in zip(axs, columns):
+        scatter_single_column(ax, time1, data1[column], time2, data2[column], f'{column} from File 1', f'{column} from File 2', color1, color2)
+        ax.set_title(f'Column {column} Comparison')
 
     # Adjust layout and save the figure
 
@@ -0,0 +1,218 @@
+/* Synthetic OpenMP kernels whose work and memory traffic are known in closed form.
+ *
+ * Every call of a kernel is exactly one parallel region, its arrays are
+ * allocated for that call with the size of the call, so my_omp.so sees the
+ * size as a feature. For each call a line with the ground truth is appended
+ * to csvs/synthetic.csv, in the same order as the regions in csvs/progress.csv:
+ *   Work  - operations the kernel performs (flops, loads, allocations or inner iterations)
+ *   Bytes - memory traffic beyond the caches, data that stays cache resident counts once
+ * Usage: synthetic <kernel> [--sizes n,...] [--threads t,...] [--reps r] [--seed s] */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#define FMA_ITERATIONS 256      // chained fmas per element of the compute-bound kernel
+#define CACHE_PASSES 64         // passes over the array of the cache-resident kernel
+#define CACHE_LINE 64
+#define ALLOC_BLOCK 64          // bytes per allocation of the allocation-heavy kernel
+
+struct Truth {
+    double work;
+    double bytes;
+};
+
+/* a[i] = b[i] + s * c[i], reads two arrays and writes one (plus the write allocate) */
+static Truth stream(long n, int threads, double &checksum) {
+    auto *a = (double *) malloc(n * sizeof(double));
+    auto *b = (double *) malloc(n * sizeof(double));
+    auto *c = (double *) malloc(n * sizeof(double));
+    for (long i = 0; i < n; i++) {
+        b[i] = (double) i;
+        c[i] = 1.0;
+    }
+
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (long i = 0; i < n; i++)
+        a[i] = b[i] + 3.0 * c[i];
+
+    checksum += a[n - 1];
+    free(a);
+    free(b);
+    free(c);
+    return {2.0 * n, 4.0 * n * sizeof(double)};
+}
+
+/* FMA_ITERATIONS dependent fmas per element in registers, one store per element */
+static Truth compute(long n, int threads, double &checksum) {
+    auto *out = (double *) malloc(n * sizeof(double));
+
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (long i = 0; i < n; i++) {
+        double x = (double) i;
+        for (int k = 0; k < FMA_ITERATIONS; k++)
+            x = x * 0.999999 + 1e-6;
+        out[i] = x;
+    }
+
+    checksum += out[n - 1];
+    free(out);
+    return {2.0 * n * FMA_ITERATIONS, 2.0 * n * sizeof(double)};
+}
+
+/* n dependent loads along one random cycle, every load a miss once the array does not fit in the cache */
+static Truth chase(long n, int threads, std::mt19937_64 &random, double &checksum) {
+    auto *next = (long *) malloc(n * sizeof(long));
+    for (long i = 0; i < n; i++) next[i] = i;
+    for (long i = n - 1; i > 0; i--)    // Sattolo, a single cycle through all elements
+        std::swap(next[i], next[std::uniform_int_distribution<long>(0, i - 1)(random)]);
+
+    long sum = 0;
+#pragma omp parallel for num_threads(threads) schedule(static) reduction(+:sum)
+    for (int t = 0; t < threads; t++) {     // each thread walks its share of the hops from its own start
+        long position = (n / threads) * t;
+        long hops = n / threads + (t < n % threads ? 1 : 0);
+        for (long h = 0; h < hops; h++) position = next[position];
+        sum += position;
+    }
+
+    checksum += (double) sum;
+    free(next);
+    return {(double) n, (double) n * CACHE_LINE};
+}
+
+/* CACHE_PASSES passes over an array small enough to stay in the cache, only the first pass misses */
+static Truth cache(long n, int threads, double &checksum) {
+    auto *a = (double *) malloc(n * sizeof(double));
+    for (long i = 0; i < n; i++) a[i] = 1.0;
+
+    double sum = 0.0;
+#pragma omp parallel num_threads(threads) reduction(+:sum)
+    for (int pass = 0; pass < CACHE_PASSES; pass++) {
+#pragma omp for schedule(static) nowait
+        for (long i = 0; i < n; i++) sum += a[i];
+    }
+
+    checksum += sum;
+    free(a);
+    return {(double) n * CACHE_PASSES, (double) n * sizeof(double)};
+}
+
+/* iteration i does i inner iterations, so the static schedule leaves the last thread the most work */
+static Truth imbalance(long n, int threads, double &checksum) {
+    auto *out = (double *) malloc(n * sizeof(double));
+
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (long i = 0; i < n; i++) {
+        double x = 0.0;
+        for (long k = 0; k < i; k++) x += 1.0 / (double) (k + 1);
+        out[i] = x;
+    }
+
+    checksum += out[n - 1];
+    free(out);
+    return {(double) n * (n - 1) / 2, (double) n * sizeof(double)};
+}
+
+/* one malloc and free of ALLOC_BLOCK bytes per iteration, results land in an array of n elements */
+static Truth alloc(long n, int threads, double &checksum) {
+    auto *out = (double *) malloc(n * sizeof(double));
+
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (long i = 0; i < n; i++) {
+        auto *block = (char *) malloc(ALLOC_BLOCK);
+        memset(block, (int) (i & 0xff), ALLOC_BLOCK);
+        out[i] = block[ALLOC_BLOCK - 1];
+        free(block);
+    }
+
+    checksum += out[n - 1];
+    free(out);
+    return {(double) n, (double) n * (ALLOC_BLOCK + sizeof(double))};
+}
+
+static std::vector<long> parse_list(const char *list) {
+    std::vector<long> values;
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, ','))
+        if (!item.empty()) values.push_back(strtol(item.c_str(), nullptr, 10));
+    return values;
+}
+
+static std::vector<long> default_sizes(const std::string &kernel) {
+    if (kernel == "cache") return {1024, 2048, 4096, 8192, 16384};     // 8 to 128 KiB
+    if (kernel == "imbalance") return {2000, 4000, 6000, 8000, 10000};
+    if (kernel == "fma" || kernel == "alloc") return {100000, 200000, 400000, 600000, 800000};
+    return {1000000, 2000000, 4000000, 6000000, 8000000};
+}
+
+static void usage() {
+    std::cerr << "usage: synthetic <stream|fma|chase|cache|imbalance|alloc> [--sizes n,...] [--threads t,...] "
+                 "[--reps r] [--seed s]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    std::string kernel = argv[1];
+    std::vector<long> sizes = default_sizes(kernel);
+    std::vector<long> threads = {omp_get_max_threads()};
+    int reps = 5;
+    unsigned long seed = 42;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--sizes")) sizes = parse_list(argv[i + 1]);
+        else if (!strcmp(argv[i], "--threads")) threads = parse_list(argv[i + 1]);
+        else if (!strcmp(argv[i], "--reps")) reps = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--seed")) seed = strtoul(argv[i + 1], nullptr, 10);
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::ofstream truth_file("./csvs/synthetic.csv");
+    if (!truth_file.is_open()) {
+        std::cout << "failed to open synthetic file" << std::endl;
+        return 1;
+    }
+    truth_file << "Calls,Kernel,Size,Threads,Work,Bytes" << std::endl;
+
+    std::mt19937_64 random(seed);
+    double checksum = 0.0;
+    long calls = 0;
+    for (int rep = 0; rep < reps; rep++) {     // every size with every thread count in each repetition
+        for (long n: sizes) {
+            for (long t: threads) {
+                if (n < 1 || t < 1) continue;
+                Truth truth;
+                if (kernel == "stream") truth = stream(n, (int) t, checksum);
+                else if (kernel == "fma") truth = compute(n, (int) t, checksum);
+                else if (kernel == "chase") truth = chase(n, (int) t, random, checksum);
+                else if (kernel == "cache") truth = cache(n, (int) t, checksum);
+                else if (kernel == "imbalance") truth = imbalance(n, (int) t, checksum);
+                else if (kernel == "alloc") truth = alloc(n, (int) t, checksum);
+                else {
+                    usage();
+                    return 1;
+                }
+                truth_file << ++calls << "," << kernel << "," << n << "," << t << "," << truth.work << ","
+                           << truth.bytes << std::endl;
+            }
+        }
+    }
+
+    printf("checksum: %f\n", checksum);
+    return 0;
+}